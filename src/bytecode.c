@@ -0,0 +1,605 @@
+// vim:noet:ts=3
+
+/* Bytecode compiler and virtual machine
+
+	Copyright (C) 2004-8 Kostas Chatzikokolakis
+	This file is part of LCI
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details. */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "bytecode.h"
+#include "decllist.h"
+#include "termalloc.h"
+#include "run.h"
+
+
+// The machine is the lazy Krivine machine of krivine.c, running on compiled
+// code instead of terms. The code of a declaration is compiled once and cached
+// in the DECL (see bcCompile), so an alias costs a jump. Closures and
+// environments are kept in two arrays (the heap), referred to by index (0 for
+// none), and the frames in a third one (the stack). The heap is emptied when a
+// query starts.
+//
+// Without trace or showexec a step runs up to VM_SLICE beta-reductions.
+
+#define VM_SLICE		65536
+
+// A closure: code and environment, or a neutral value (no code) whose head is
+// bound by the level-th abstraction of the normal form (level >= 0) or is the
+// free variable with symbol id -level-1. Its arguments are kept in env, the
+// last one first.
+typedef struct {
+	int *pc;
+	int env;
+	int level;
+	char evaluated;
+} VMCLOS;
+
+typedef struct {
+	int c;
+	int next;
+} VMENV;
+
+// frames of the stack, see krivine.c
+typedef enum { VF_ARG, VF_UPD, VF_LAM, VF_APP } VMFRAME_KIND;
+
+typedef struct {
+	VMFRAME_KIND kind;
+	int n;
+	int c;
+	int l;
+	int *pc;
+	DBTERM t;
+} VMFRAME;
+
+typedef enum { VM_EVAL, VM_VALUE, VM_TERM, VM_DONE } VMMODE;
+
+typedef struct {
+	VMMODE mode;
+	int *pc;
+	int env;
+	int val;
+	DBTERM res;
+	int depth;
+	int sp;
+	TERM *shown;							// last term returned by bytecodeTerm
+} VMSTATE;
+
+static VMCLOS *clos = NULL;
+static VMENV *envs = NULL;
+static VMFRAME *stack = NULL;
+static int closNo, closSize = 0,
+			  envNo, envSize = 0,
+			  stackSize = 0,
+			  stackCharged;						// frames charged to the query arena
+
+static int *code = NULL;				// code of the running query
+static int *buf = NULL;					// compiler output
+static int bufNo, bufSize = 0;
+
+
+// grow
+//
+// Makes room for one more element in array *a of *size elements of elsize
+// bytes, if no is the number of elements in use.
+
+static void grow(void **a, int *size, int no, size_t elsize) {
+	if(no < *size)
+		return;
+
+	*size = *size ? 2 * *size : 1024;
+	if(!(*a = realloc(*a, *size * elsize))) {
+		fprintf(stderr, "Error: out of memory.\n");
+		exit(1);
+	}
+}
+
+// emit
+//
+// Appends an instruction to the compiler output
+
+static void emit(OPCODE op, int arg) {
+	grow((void**)&buf, &bufSize, bufNo + 1, sizeof(int));
+	buf[bufNo++] = op;
+	buf[bufNo++] = arg;
+}
+
+// compile
+//
+// Appends the code of t. The code of an argument follows the code of the
+// function, so it is compiled in the loop, only functions are compiled by
+// nested calls.
+
+static void compile(DBTERM t) {
+	DBTERM r;
+	int at;
+
+	for(;;) switch(DB_TYPE(t)) {
+	 case DB_VAR:
+		emit(OP_ACCESS, DB_INDEX(t));
+		return;
+
+	 case DB_FREE:
+		emit(OP_FREE, symbolId(DB_NAME(t)));
+		return;
+
+	 case DB_ALIAS:
+		emit(OP_ALIAS, symbolId(DB_NAME(t)));
+		return;
+
+	 case DB_ABSTR:
+		emit(OP_GRAB, symbolId(DB_NAME(t)));
+		t = DB_R(t);
+		break;
+
+	 case DB_APPL:
+		r = DB_R(t);
+		if(DB_TYPE(r) == DB_VAR) {
+			emit(OP_PUSHVAR, DB_INDEX(r));
+			t = DB_L(t);
+			break;
+		}
+
+		at = bufNo;
+		emit(DB_LOOSE(r) ? OP_PUSH : OP_PUSHC, 0);
+		compile(DB_L(t));
+		buf[at + 1] = bufNo - at;
+		t = r;
+		break;
+
+	 default:
+		assert(0);
+		return;
+	}
+}
+
+// bcCompile
+//
+// Returns the code of t, in a block allocated with malloc
+
+int *bcCompile(DBTERM t) {
+	int *c;
+
+	bufNo = 0;
+	compile(t);
+
+	if(!(c = malloc(bufNo * sizeof(int)))) {
+		fprintf(stderr, "Error: out of memory.\n");
+		exit(1);
+	}
+	memcpy(c, buf, bufNo * sizeof(int));
+	return c;
+}
+
+// aliasCode
+//
+// Returns the code of the declaration with symbol id, compiled on first use.
+// Returns NULL if it is not declared.
+
+static int *aliasCode(int id) {
+	char *name = symbolName(id);
+	DECL *decl = getDecl(name);
+
+	if(!decl) {
+		printf("Error: Alias %s is not declared.\n", name);
+		return NULL;
+	}
+
+	if(!decl->code)
+		decl->code = bcCompile(dbFromDecl(name));
+	return decl->code;
+}
+
+// newClos, newEnv
+//
+// Allocate a closure and an environment cell in the heap. They are charged to
+// the query arena (HEAP_CHARGE cells at a time), so that the memory limit applies.
+
+#define HEAP_CHARGE	1024
+
+static int newClos(int *pc, int env) {
+	VMCLOS *c;
+
+	grow((void**)&clos, &closSize, closNo, sizeof(VMCLOS));
+	if(closNo % HEAP_CHARGE == 0)
+		arenaCharge(AR_QUERY, HEAP_CHARGE * sizeof(VMCLOS));
+
+	c = &clos[closNo];
+	c->pc = pc;
+	c->env = env;
+	c->evaluated = pc && *pc == OP_GRAB;
+	return closNo++;
+}
+
+static int newEnv(int c, int next) {
+	grow((void**)&envs, &envSize, envNo, sizeof(VMENV));
+	if(envNo % HEAP_CHARGE == 0)
+		arenaCharge(AR_QUERY, HEAP_CHARGE * sizeof(VMENV));
+
+	envs[envNo].c = c;
+	envs[envNo].next = next;
+	return envNo++;
+}
+
+// newNeutral
+//
+// Returns a neutral value with the given head and arguments
+
+static int newNeutral(int level, int args) {
+	int c = newClos(NULL, args);
+
+	clos[c].level = level;
+	return c;
+}
+
+// lookup
+//
+// Returns the value of index i in env
+
+static int lookup(int env, int i) {
+	while(i--)
+		env = envs[env].next;
+	return envs[env].c;
+}
+
+// push
+//
+// Pushes a frame to the stack and returns it
+
+static VMFRAME *push(VMSTATE *st, VMFRAME_KIND kind) {
+	grow((void**)&stack, &stackSize, st->sp, sizeof(VMFRAME));
+	if(st->sp == stackCharged) {
+		arenaCharge(AR_QUERY, HEAP_CHARGE * sizeof(VMFRAME));
+		stackCharged += HEAP_CHARGE;
+	}
+	stack[st->sp].kind = kind;
+	return &stack[st->sp++];
+}
+
+// newHead
+//
+// Returns the head variable of neutral value c, read back at the given depth
+
+static DBTERM newHead(int c, int depth) {
+	DBTERM t;
+
+	if(clos[c].level >= 0)
+		return dbNewVar(depth - 1 - clos[c].level);
+
+	t = dbNew(DB_FREE);
+	DB_SETNAME(t, symbolName(-clos[c].level - 1));
+	return t;
+}
+
+// force
+//
+// Continues with the evaluation of closure c (see krivine.c)
+
+static void force(VMSTATE *st, int c) {
+	if(!clos[c].pc) {
+		st->val = c;
+		st->mode = VM_VALUE;
+		return;
+	}
+
+	if(!clos[c].evaluated)
+		push(st, VF_UPD)->c = c;
+
+	st->pc = clos[c].pc;
+	st->env = clos[c].env;
+	st->mode = VM_EVAL;
+}
+
+// bytecodeStep
+//
+// Runs the machine until limit beta-reductions are performed or the normal form
+// is found. Returns the number of reductions, or -1 if an undeclared alias is met.
+
+static int bytecodeStep(void *state) {
+	VMSTATE *st = state;
+	VMFRAME *f;
+	int limit = trace || getOption(OPT_SHOWEXEC) ? 1 : VM_SLICE,
+		 n = 0, c, l, e;
+	int *pc;
+	DBTERM t, body;
+
+	for(;;) switch(st->mode) {
+	 case VM_EVAL:
+		pc = st->pc;
+
+		switch(*pc) {
+		 case OP_PUSH:
+			c = newClos(pc + pc[1], st->env);
+			push(st, VF_ARG)->c = c;
+			st->pc += 2;
+			break;
+
+		 case OP_PUSHC:
+			c = newClos(pc + pc[1], 0);
+			push(st, VF_ARG)->c = c;
+			st->pc += 2;
+			break;
+
+		 case OP_PUSHVAR:
+			c = lookup(st->env, pc[1]);
+			push(st, VF_ARG)->c = c;
+			st->pc += 2;
+			break;
+
+		 case OP_ACCESS:
+			force(st, lookup(st->env, pc[1]));
+			break;
+
+		 case OP_FREE:
+			st->val = newNeutral(-pc[1] - 1, 0);
+			st->mode = VM_VALUE;
+			break;
+
+		 case OP_ALIAS:
+			if(!(st->pc = aliasCode(pc[1])))
+				return -1;
+			st->env = 0;
+			break;
+
+		 case OP_GRAB:
+			// the thunks waiting for this value are updated
+			for(; st->sp && (f = &stack[st->sp - 1])->kind == VF_UPD; st->sp--) {
+				clos[f->c].pc = pc;
+				clos[f->c].env = st->env;
+				clos[f->c].evaluated = 1;
+			}
+
+			// beta-reduction
+			if(st->sp && f->kind == VF_ARG) {
+				st->env = newEnv(f->c, st->env);
+				st->pc += 2;
+				st->sp--;
+				if(++n == limit || memExceeded)
+					return n;
+				break;
+			}
+
+			// weak head normal form, the body is read back
+			f = push(st, VF_LAM);
+			f->pc = pc;
+			f->n = ++st->depth;
+
+			c = newNeutral(st->depth - 1, 0);
+			st->env = newEnv(c, st->env);
+			st->pc += 2;
+			break;
+
+		 default:
+			assert(0);
+			return -1;
+		}
+		break;
+
+	 case VM_VALUE:
+		c = st->val;
+		f = st->sp ? &stack[st->sp - 1] : NULL;
+
+		if(f && f->kind == VF_UPD) {
+			clos[f->c] = clos[c];
+			st->sp--;
+
+		} else if(f && f->kind == VF_ARG) {
+			e = newEnv(f->c, clos[c].env);
+			st->val = newNeutral(clos[c].level, e);
+			st->sp--;
+
+		} else {
+			// read back the arguments, first one first
+			for(l = 0, e = clos[c].env; e; e = envs[e].next)
+				l = newEnv(envs[e].c, l);
+			st->res = newHead(c, st->depth);
+
+			if(!l)
+				st->mode = VM_TERM;
+			else {
+				f = push(st, VF_APP);
+				f->t = st->res;
+				f->l = envs[l].next;
+				f->n = st->depth;
+				force(st, envs[l].c);
+			}
+		}
+		break;
+
+	 case VM_TERM:
+		if(!st->sp) {
+			st->mode = VM_DONE;
+			return n;
+		}
+
+		f = &stack[st->sp - 1];
+		body = st->res;
+
+		if(f->kind == VF_LAM) {
+			// eta-reduction, \.M 0 -> M  if 0 not free in M
+			if(DB_TYPE(body) == DB_APPL &&
+				DB_TYPE(DB_R(body)) == DB_VAR &&
+				DB_INDEX(DB_R(body)) == 0 &&
+				!dbIsFree(DB_L(body), 0)) {
+
+				st->res = DB_L(body);
+				dbShift(st->res, -1, 0);
+				dbFreeNode(DB_R(body));
+				dbFreeNode(body);
+			} else
+				st->res = dbNewAbstr(symbolName(f->pc[1]), body);
+
+			st->depth = f->n - 1;
+			st->sp--;
+
+		} else {
+			assert(f->kind == VF_APP);
+			t = dbNewAppl(f->t, body);
+			st->depth = f->n;
+
+			if(!f->l) {
+				st->res = t;
+				st->sp--;
+			} else {
+				f->t = t;
+				c = envs[f->l].c;
+				f->l = envs[f->l].next;
+				force(st, c);
+			}
+		}
+		break;
+
+	 case VM_DONE:
+		return 0;
+	}
+}
+
+// unloadClos, unloadCode, unloadArgs
+//
+// Return the term represented by a closure, by code in env or by a neutral
+// value applied to args (see krivine.c)
+
+static DBTERM unloadCode(int *pc, int env, int depth, int k);
+static DBTERM unloadClos(int c, int depth);
+
+static DBTERM unloadArgs(int c, int args, int depth) {
+	DBTERM l, r;
+
+	if(!args)
+		return newHead(c, depth);
+
+	l = unloadArgs(c, envs[args].next, depth);
+	r = unloadClos(envs[args].c, depth);
+	return dbNewAppl(l, r);
+}
+
+static DBTERM unloadClos(int c, int depth) {
+	return clos[c].pc
+		? unloadCode(clos[c].pc, clos[c].env, depth, 0)
+		: unloadArgs(c, clos[c].env, depth);
+}
+
+static DBTERM unloadCode(int *pc, int env, int depth, int k) {
+	DBTERM t, l, r;
+
+	switch(*pc) {
+	 case OP_ACCESS:
+		return pc[1] < k
+			? dbNewVar(pc[1])
+			: unloadClos(lookup(env, pc[1] - k), depth + k);
+
+	 case OP_GRAB:
+		r = unloadCode(pc + 2, env, depth, k + 1);
+		return dbNewAbstr(symbolName(pc[1]), r);
+
+	 case OP_PUSHVAR:
+		l = unloadCode(pc + 2, env, depth, k);
+		r = pc[1] < k
+			? dbNewVar(pc[1])
+			: unloadClos(lookup(env, pc[1] - k), depth + k);
+		return dbNewAppl(l, r);
+
+	 case OP_PUSH:
+	 case OP_PUSHC:
+		l = unloadCode(pc + 2, env, depth, k);
+		r = unloadCode(pc + pc[1], env, depth, k);
+		return dbNewAppl(l, r);
+
+	 default:
+		t = dbNew(*pc == OP_FREE ? DB_FREE : DB_ALIAS);
+		DB_SETNAME(t, symbolName(pc[1]));
+		return t;
+	}
+}
+
+
+// ------- Engine interface --------
+
+static void *bytecodeStart(TERM *t) {
+	VMSTATE *st = arenaAlloc(sizeof(VMSTATE));
+
+	free(code);
+	code = bcCompile(dbFromTerm(t));
+	closNo = envNo = 1;
+	stackCharged = 0;
+
+	st->mode = VM_EVAL;
+	st->pc = code;
+	st->env = 0;
+	st->depth = 0;
+	st->sp = 0;
+	st->shown = NULL;
+	return st;
+}
+
+// bytecodeTerm
+//
+// Returns the normal form, or while the machine runs the term it represents
+
+static TERM *bytecodeTerm(void *state) {
+	VMSTATE *st = state;
+	VMFRAME *f;
+	DBTERM t, r;
+	int i, l, depth = st->depth;
+
+	switch(st->mode) {
+	 case VM_EVAL:
+		t = unloadCode(st->pc, st->env, depth, 0);
+		break;
+	 case VM_VALUE:
+		t = unloadClos(st->val, depth);
+		break;
+	 default:
+		t = st->res;
+	}
+
+	for(i = st->sp - 1; i >= 0; i--) {
+		f = &stack[i];
+
+		switch(f->kind) {
+		 case VF_ARG:
+			r = unloadClos(f->c, depth);
+			t = dbNewAppl(t, r);
+			break;
+
+		 case VF_UPD:
+			break;
+
+		 case VF_LAM:
+			t = dbNewAbstr(symbolName(f->pc[1]), t);
+			depth = f->n - 1;
+			break;
+
+		 case VF_APP:
+			t = dbNewAppl(f->t, t);
+			for(l = f->l; l; l = envs[l].next) {
+				r = unloadClos(envs[l].c, depth);
+				t = dbNewAppl(t, r);
+			}
+			break;
+		}
+	}
+
+	termFree(st->shown);
+	st->shown = dbToTerm(t);
+	return st->shown;
+}
+
+ENGINE bytecodeEngine = { "bytecode", bytecodeStart, bytecodeStep, bytecodeTerm, NULL };
@@ -0,0 +1,46 @@
+// vim:noet:ts=3
+
+/* Declarations for bytecode.c
+
+	Copyright (C) 2004-8 Kostas Chatzikokolakis
+	This file is part of LCI
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details. */
+
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "dbterm.h"
+#include "engine.h"
+
+
+// Instructions, each one is followed by an operand. The code of a term is
+//		x				ACCESS index
+//		\x.M			GRAB symbol id of x, code of M
+//		M N			PUSH offset of N (PUSHC if N is closed), code of M, code of N
+//		M x			PUSHVAR index of x, code of M
+//		free var		FREE symbol id
+//		alias			ALIAS symbol id
+// The offset of PUSH is relative to the instruction itself.
+
+typedef enum { OP_ACCESS, OP_GRAB, OP_PUSH, OP_PUSHC, OP_PUSHVAR, OP_FREE, OP_ALIAS } OPCODE;
+
+
+int *bcCompile(DBTERM t);
+
+extern ENGINE bytecodeEngine;
+
+
+#endif
@@ -0,0 +1,807 @@
+// vim:noet:ts=3
+
+/* Reduction engine using de Bruijn indices
+
+	Copyright (C) 2004-8 Kostas Chatzikokolakis
+	This file is part of LCI
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details. */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "dbterm.h"
+#include "termproc.h"
+#include "decllist.h"
+#include "symbol.h"
+#include "run.h"
+
+
+// names of the enclosing binders during conversions, env[depth-1] is the innermost
+char **dbEnv = NULL;
+int dbEnvSize = 0;
+
+
+// envPush
+//
+// Stores name as the name of the binder at the given depth
+
+static void envPush(int depth, char *name) {
+	if(depth >= dbEnvSize) {
+		dbEnvSize = dbEnvSize ? 2 * dbEnvSize : 64;
+		dbEnv = realloc(dbEnv, dbEnvSize * sizeof(char*));
+	}
+	dbEnv[depth] = name;
+}
+
+#ifndef COMPACT_TERMS
+
+DBTERM dbNew(DBTERM_TYPE type) {
+	DBTERM t = arenaAlloc(sizeof(DBNODE));
+
+	t->type = type;
+	t->lterm = t->rterm = NULL;
+	t->name = NULL;
+	t->index = 0;
+	t->loose = 0;
+	t->preced = 0;
+
+	return t;
+}
+
+// dbFreeNode
+//
+// Frees only the node t, without its children
+
+void dbFreeNode(DBTERM t) {
+	arenaFree(t, sizeof(DBNODE));
+}
+
+// dbGC
+//
+// Releases all terms of the running query. Nodes are allocated in the
+// arenas, so termGC has already done it.
+
+void dbGC() {
+}
+
+// dbCopyNode
+//
+// Copies all fields of s to d
+
+static void dbCopyNode(DBTERM d, DBTERM s) {
+	*d = *s;
+}
+
+#else
+
+DBSTORE dbStore[AR_NO];
+
+// storeGrow
+//
+// Doubles the size of the arrays of store s
+
+static void storeGrow(DBSTORE *s) {
+	unsigned int size = s->size ? 2 * s->size : DB_STORE_INITSIZE;
+
+	if(size > 0x80000000 ||
+		!(s->type = realloc(s->type, size * sizeof(*s->type))) ||
+		!(s->preced = realloc(s->preced, size * sizeof(*s->preced))) ||
+		!(s->loose = realloc(s->loose, size * sizeof(*s->loose))) ||
+		!(s->lterm = realloc(s->lterm, size * sizeof(*s->lterm))) ||
+		!(s->rterm = realloc(s->rterm, size * sizeof(*s->rterm))) ||
+		!(s->sym = realloc(s->sym, size * sizeof(*s->sym)))) {
+		fprintf(stderr, "Error: out of memory.\n");
+		exit(1);
+	}
+
+	s->size = size;
+}
+
+DBTERM dbNew(DBTERM_TYPE type) {
+	ARENA_ID a = arenaCurrent();
+	DBSTORE *s = &dbStore[a];
+	DBTERM t;
+
+	// the top bit of a handle holds the arena
+	assert(AR_NO <= 2);
+
+	if(s->freeList) {
+		t = s->freeList;
+		s->freeList = s->lterm[DB_I(t)];
+	} else {
+		if(s->top == 0)
+			s->top = 1;						// 0 stands for DB_NULL
+		if(s->top >= s->size)
+			storeGrow(s);
+		t = (DBTERM)a << 31 | s->top++;
+		arenaCharge(a, DB_NODE_SIZE);
+	}
+	arenas[a].liveNo++;
+	arenas[a].liveSize += DB_NODE_SIZE;
+
+	DB_TYPE(t) = type;
+	DB_L(t) = DB_R(t) = DB_NULL;
+	DB_INDEX(t) = 0;
+	DB_LOOSE(t) = 0;
+	DB_PRECED(t) = 0;
+
+	return t;
+}
+
+// dbFreeNode
+//
+// Frees only the node t, without its children. The node goes to the free list
+// of the store it belongs to.
+
+void dbFreeNode(DBTERM t) {
+	DB_L(t) = DB_S(t).freeList;
+	DB_S(t).freeList = t;
+	arenas[DB_ARENA(t)].liveNo--;
+	arenas[DB_ARENA(t)].liveSize -= DB_NODE_SIZE;
+}
+
+// dbGC
+//
+// Releases all terms of the running query (the arrays are kept for the
+// following queries).
+
+void dbGC() {
+	dbStore[AR_QUERY].top = 1;
+	dbStore[AR_QUERY].freeList = DB_NULL;
+}
+
+// dbCopyNode
+//
+// Copies all fields of s to d
+
+static void dbCopyNode(DBTERM d, DBTERM s) {
+	DB_TYPE(d) = DB_TYPE(s);
+	DB_PRECED(d) = DB_PRECED(s);
+	DB_LOOSE(d) = DB_LOOSE(s);
+	DB_L(d) = DB_L(s);
+	DB_R(d) = DB_R(s);
+	DB_INDEX(d) = DB_INDEX(s);
+}
+
+#endif
+
+// dbFree
+//
+// Frees t and all its subterms. Right-hand children are followed in a loop, so
+// long right spines (eg. numerals) do not consume stack.
+
+void dbFree(DBTERM t) {
+	DBTERM next;
+
+	for(; t; t = next) {
+		next = DB_R(t);
+		if(DB_TYPE(t) == DB_APPL)
+			dbFree(DB_L(t));
+		else if(DB_TYPE(t) != DB_ABSTR)
+			next = DB_NULL;
+
+		dbFreeNode(t);
+	}
+}
+
+// dbNewVar, dbNewAbstr, dbNewAppl
+//
+// Return a new variable, abstraction or application with the given contents.
+// Their loose field is computed from the children.
+
+DBTERM dbNewVar(int index) {
+	DBTERM t = dbNew(DB_VAR);
+
+	DB_INDEX(t) = index;
+	DB_LOOSE(t) = LOOSE_VAR(index);
+	return t;
+}
+
+DBTERM dbNewAbstr(char *name, DBTERM body) {
+	DBTERM t = dbNew(DB_ABSTR);
+
+	DB_SETNAME(t, name);
+	DB_R(t) = body;
+	DB_LOOSE(t) = LOOSE_ABSTR(DB_LOOSE(body));
+	return t;
+}
+
+DBTERM dbNewAppl(DBTERM l, DBTERM r) {
+	DBTERM t = dbNew(DB_APPL);
+
+	DB_L(t) = l;
+	DB_R(t) = r;
+	DB_LOOSE(t) = LOOSE_APPL(DB_LOOSE(l), DB_LOOSE(r));
+	return t;
+}
+
+// dbClone
+//
+// Returns a clone of t in which all indices pointing outside t by at least cutoff
+// levels are increased by shift. The loose field of the clone is exact if the
+// one of t is.
+
+DBTERM dbClone(DBTERM t, int shift, int cutoff) {
+	DBTERM newTerm = dbNew(DB_TYPE(t)), c;
+
+	dbCopyNode(newTerm, t);
+
+	// nothing to shift if no variable points outside the cutoff
+	if(DB_LOOSE(t) <= cutoff)
+		shift = 0;
+	else if(DB_LOOSE(t) != DB_LOOSE_MAX)
+		DB_LOOSE(newTerm) += shift;
+
+	switch(DB_TYPE(t)) {
+	 case DB_VAR:
+		if(DB_INDEX(t) >= cutoff)
+			DB_INDEX(newTerm) += shift;
+		break;
+
+	 case DB_ABSTR:
+		c = dbClone(DB_R(t), shift, cutoff + 1);
+		DB_R(newTerm) = c;
+		break;
+
+	 case DB_APPL:
+		c = dbClone(DB_L(t), shift, cutoff);
+		DB_L(newTerm) = c;
+		c = dbClone(DB_R(t), shift, cutoff);
+		DB_R(newTerm) = c;
+		break;
+
+	 default:
+		;
+	}
+
+	return newTerm;
+}
+
+// dbShift
+//
+// Same as dbClone but modifies t in place
+
+void dbShift(DBTERM t, int shift, int cutoff) {
+	if(DB_LOOSE(t) <= cutoff)
+		return;
+
+	switch(DB_TYPE(t)) {
+	 case DB_VAR:
+		DB_INDEX(t) += shift;
+		DB_LOOSE(t) = LOOSE_VAR(DB_INDEX(t));
+		break;
+
+	 case DB_ABSTR:
+		dbShift(DB_R(t), shift, cutoff + 1);
+		DB_LOOSE(t) = LOOSE_ABSTR(DB_LOOSE(DB_R(t)));
+		break;
+
+	 case DB_APPL:
+		dbShift(DB_L(t), shift, cutoff);
+		dbShift(DB_R(t), shift, cutoff);
+		DB_LOOSE(t) = LOOSE_APPL(DB_LOOSE(DB_L(t)), DB_LOOSE(DB_R(t)));
+		break;
+
+	 default:
+		;
+	}
+}
+
+// churchNum
+//
+// Returns the Church numeral \f.\x.f^n(x) (the form of TM_NUM terms, see
+// termChurchNum)
+
+static DBTERM churchNum(int n) {
+	DBTERM body = dbNewVar(0);
+
+	for(; n > 0; n--)
+		body = dbNewAppl(dbNewVar(1), body);
+
+	body = dbNewAbstr(intern("x"), body);
+	return dbNewAbstr(intern("f"), body);
+}
+
+// decimalNum
+//
+// Returns a term that reduces to the Church numeral of the decimal number s,
+// of size linear in its digits: 10m+d is \f.\x.m (c10 f) (f^d(x)), where c10
+// is the Church numeral 10 (f is not copied inside c10, so substituting it
+// does not make the term grow exponentially). Numerals above decimalMin are
+// written this way instead of being built in full, which is not possible for
+// the ones that do not fit in an int.
+
+#define DECIMAL_MIN	99999
+
+static int decimalMin = DECIMAL_MIN;
+
+static DBTERM decimalNum(char *s) {
+	DBTERM t = churchNum(*s++ - '0'), step, base;
+	int i;
+
+	for(; *s; s++) {
+		step = dbNewAppl(churchNum(10), dbNewVar(1));
+
+		for(base = dbNewVar(0), i = 0; i < *s - '0'; i++)
+			base = dbNewAppl(dbNewVar(1), base);
+
+		// m is closed, it needs no shifting
+		t = dbNewAbstr(intern("f"), dbNewAbstr(intern("x"), dbNewAppl(dbNewAppl(t, step), base)));
+	}
+	return t;
+}
+
+// fromTerm
+//
+// Converts t which lies under depth binders (their names are in dbEnv)
+
+static DBTERM fromTerm(TERM *t, int depth) {
+	DBTERM newTerm, c;
+	TERM *l;
+	char *name, num[16];
+	int i;
+
+	switch(t->type) {
+	 case TM_VAR:
+		// search the innermost binder with the same name
+		for(i = depth - 1; i >= 0 && dbEnv[i] != t->name; i--)
+			;
+
+		if(i >= 0) {
+			newTerm = dbNew(DB_VAR);
+			DB_INDEX(newTerm) = depth - 1 - i;
+			DB_LOOSE(newTerm) = LOOSE_VAR(DB_INDEX(newTerm));
+		} else {
+			newTerm = dbNew(DB_FREE);
+			DB_SETNAME(newTerm, t->name);
+		}
+		break;
+
+	 case TM_ALIAS:
+		newTerm = dbNew(DB_ALIAS);
+		DB_SETNAME(newTerm, t->name);
+		break;
+
+	 case TM_NUM:
+		if(t->big) {
+			name = bigToString(t->big);
+			newTerm = decimalNum(name);
+			free(name);
+		} else if(t->num > decimalMin) {
+			sprintf(num, "%d", t->num);
+			newTerm = decimalNum(num);
+		} else
+			newTerm = churchNum(t->num);
+		break;
+
+	 case TM_LIST:
+		l = termFromList(t->list);
+		newTerm = fromTerm(l, depth);
+		termFree(l);
+		break;
+
+	 case TM_ABSTR:
+		newTerm = dbNew(DB_ABSTR);
+		DB_SETNAME(newTerm, t->lterm->name);
+
+		envPush(depth, t->lterm->name);
+		c = fromTerm(t->rterm, depth + 1);
+		DB_R(newTerm) = c;
+		DB_LOOSE(newTerm) = LOOSE_ABSTR(DB_LOOSE(c));
+		break;
+
+	 case TM_APPL:
+	 default:
+		newTerm = dbNew(DB_APPL);
+		DB_PRECED(newTerm) = t->preced;
+		c = fromTerm(t->lterm, depth);
+		DB_L(newTerm) = c;
+		c = fromTerm(t->rterm, depth);
+		DB_R(newTerm) = c;
+		DB_LOOSE(newTerm) = LOOSE_APPL(DB_LOOSE(DB_L(newTerm)), DB_LOOSE(c));
+		break;
+	}
+
+	return newTerm;
+}
+
+// dbFromTerm
+//
+// Converts t to de Bruijn representation
+
+DBTERM dbFromTerm(TERM *t) {
+	return fromTerm(t, 0);
+}
+
+// dbFromTermDecimal
+//
+// Like dbFromTerm, but all numerals above 9 are written in decimal form (see
+// decimalNum). Used by the optimal engine, which reads a numeral back one
+// occurrence of f at a time, through the brackets of all the arguments that
+// enclose it: the full chain would take quadratic time.
+
+DBTERM dbFromTermDecimal(TERM *t) {
+	DBTERM res;
+
+	decimalMin = 9;
+	res = fromTerm(t, 0);
+	decimalMin = DECIMAL_MIN;
+	return res;
+}
+
+// nameClash
+//
+// Returns 1 if name is used in t (which lies under c binders of the term being
+// named) to refer to something other than the binder being named, that is
+// either to a free variable or to one of the binders stored in dbEnv[0..depth-1].
+// Right children are followed in a loop.
+
+static int nameClash(DBTERM t, int c, char *name, int depth) {
+	int outer;
+
+	for(;;) switch(DB_TYPE(t)) {
+	 case DB_VAR:
+		outer = DB_INDEX(t) - c - 1;
+		return outer >= 0 && outer < depth && dbEnv[depth - 1 - outer] == name;
+
+	 case DB_FREE:
+		return DB_NAME(t) == name;
+
+	 case DB_ABSTR:
+		t = DB_R(t);
+		c++;
+		break;
+
+	 case DB_APPL:
+		if(nameClash(DB_L(t), c, name, depth))
+			return 1;
+		t = DB_R(t);
+		break;
+
+	 default:
+		return 0;
+	}
+}
+
+// nameBound
+//
+// Returns 1 if name is used by one of the binders stored in dbEnv[0..depth-1]
+
+static int nameBound(char *name, int depth) {
+	while(depth--)
+		if(dbEnv[depth] == name)
+			return 1;
+	return 0;
+}
+
+// toTerm
+//
+// Converts t which lies under depth binders back to a TERM. Abstractions keep
+// their name hint unless this would capture some other variable, in which case
+// (or if they have no hint) a new name is selected in the same order as
+// getVariable, which does not shadow an enclosing binder either. Right children
+// are converted in a loop, so long right spines (eg. numerals) do not consume
+// stack.
+
+static TERM *toTerm(DBTERM t, int depth) {
+	TERM *res, **slot = &res, *newTerm;
+	char s[10], *name;
+
+	for(;;) {
+		newTerm = *slot = termNew();
+		newTerm->name = NULL;
+
+		switch(DB_TYPE(t)) {
+		 case DB_VAR:
+			newTerm->type = TM_VAR;
+			newTerm->name = DB_INDEX(t) < depth
+				? dbEnv[depth - 1 - DB_INDEX(t)]
+				: intern("?");
+			return res;
+
+		 case DB_FREE:
+			newTerm->type = TM_VAR;
+			newTerm->name = DB_NAME(t);
+			return res;
+
+		 case DB_ALIAS:
+			newTerm->type = TM_ALIAS;
+			newTerm->name = DB_NAME(t);
+			newTerm->closed = 1;
+			return res;
+
+		 case DB_ABSTR:
+			name = DB_NAME(t);
+			if(!name || nameClash(DB_R(t), 0, name, depth)) {
+				strcpy(s, "a");
+				while(nameClash(DB_R(t), 0, intern(s), depth) || nameBound(intern(s), depth))
+					nextVariable(s);
+				name = intern(s);
+			}
+			envPush(depth, name);
+
+			newTerm->type = TM_ABSTR;
+			newTerm->lterm = termNew();
+			newTerm->lterm->type = TM_VAR;
+			newTerm->lterm->name = name;
+			depth++;
+			break;
+
+		 case DB_APPL:
+			newTerm->type = TM_APPL;
+			newTerm->preced = DB_PRECED(t);
+			newTerm->lterm = toTerm(DB_L(t), depth);
+			break;
+		}
+
+		slot = &newTerm->rterm;
+		t = DB_R(t);
+	}
+}
+
+// dbToTerm
+//
+// Converts t back to the usual representation
+
+TERM *dbToTerm(DBTERM t) {
+	return toTerm(t, 0);
+}
+
+// dbFromDecl
+//
+// Returns the de Bruijn form of the declaration with the given id, or DB_NULL
+// if it does not exist. The form is computed once and cached in the declaration
+// (it must not be modified, callers should clone it).
+
+DBTERM dbFromDecl(char *id) {
+	DECL *decl = getDecl(id);
+	ARENA_ID prev;
+
+	if(!decl)
+		return DB_NULL;
+
+	if(!decl->dbterm) {
+		prev = arenaSelect(AR_DECL);
+		decl->dbterm = dbFromTerm(decl->term);
+		arenaSelect(prev);
+	}
+
+	return decl->dbterm;
+}
+
+// dbIsFree
+//
+// Returns 1 if index (relative to the root of t) appears in t
+
+int dbIsFree(DBTERM t, int index) {
+	for(;;) {
+		if(DB_LOOSE(t) <= index)
+			return 0;
+
+		switch(DB_TYPE(t)) {
+		 case DB_VAR:
+			return DB_INDEX(t) == index;
+
+		 case DB_ABSTR:
+			t = DB_R(t);
+			index++;
+			break;
+
+		 case DB_APPL:
+			if(dbIsFree(DB_L(t), index))
+				return 1;
+			t = DB_R(t);
+			break;
+
+		 default:
+			return 0;
+		}
+	}
+}
+
+// dbSubst
+//
+// Replaces index d in t by N (shifted by d) and decreases all indices pointing
+// further out, since the binder of d is removed. Returns the resulting term. N
+// itself is used for the first occurrence that needs no shifting (*used is
+// set), and clones for the others.
+
+static DBTERM dbSubst(DBTERM t, int d, DBTERM N, int *used) {
+	DBTERM res;
+
+	// no variable of t points to d or further out
+	if(DB_LOOSE(t) <= d)
+		return t;
+
+	switch(DB_TYPE(t)) {
+	 case DB_VAR:
+		if(DB_INDEX(t) != d) {
+			DB_INDEX(t)--;
+			DB_LOOSE(t) = LOOSE_VAR(DB_INDEX(t));
+			return t;
+		}
+
+		if(!*used && (d == 0 || DB_LOOSE(N) == 0)) {
+			res = N;
+			*used = 1;
+		} else
+			res = dbClone(N, d, 0);
+
+		dbFreeNode(t);
+		return res;
+
+	 case DB_ABSTR:
+		res = dbSubst(DB_R(t), d + 1, N, used);
+		DB_R(t) = res;
+		DB_LOOSE(t) = LOOSE_ABSTR(DB_LOOSE(res));
+		return t;
+
+	 case DB_APPL:
+		res = dbSubst(DB_L(t), d, N, used);
+		DB_L(t) = res;
+		res = dbSubst(DB_R(t), d, N, used);
+		DB_R(t) = res;
+		DB_LOOSE(t) = LOOSE_APPL(DB_LOOSE(DB_L(t)), DB_LOOSE(res));
+		return t;
+
+	 default:
+		return t;
+	}
+}
+
+// dbAliasSubst
+//
+// Substitutes alias t with a copy of its declaration. Returns 0 on success
+// or 1 if the alias is undefined.
+
+static int dbAliasSubst(DBTERM t) {
+	DBTERM decl, newTerm;
+
+	if(!(decl = dbFromDecl(DB_NAME(t)))) {
+		printf("Error: Alias %s is not declared.\n", DB_NAME(t));
+		return 1;
+	}
+
+	newTerm = dbClone(decl, 0, 0);
+	dbCopyNode(t, newTerm);
+	dbFreeNode(newTerm);
+
+	return 0;
+}
+
+// dbConv
+//
+// Performs the left-most beta or eta reduction in term t. The search follows
+// exactly termConv, so both engines perform the same sequence of reductions
+// (except for the numeric rules of termConv, numerals are Church numerals here).
+//
+// Returns
+// 	1	If a reduction was found
+//		0	If there is no reduction
+//		-1	If some error happened
+
+int dbConv(DBTERM t) {
+	DBTERM L, M, N, res;
+	int used, r;
+
+	switch(DB_TYPE(t)) {
+	 case DB_VAR:
+	 case DB_FREE:
+		return 0;
+
+	 case DB_ABSTR:
+		// Check for eta-conversion
+		// \.M 0 -> M  if 0 not free in M
+		L = DB_R(t);
+
+		if(DB_TYPE(L) == DB_APPL &&
+			DB_TYPE(DB_R(L)) == DB_VAR &&
+			DB_INDEX(DB_R(L)) == 0 &&
+			!dbIsFree(DB_L(L), 0)) {
+
+			M = DB_L(L);
+			N = DB_R(L);
+
+			// removing the binder brings everything in M one level out
+			dbShift(M, -1, 0);
+			dbCopyNode(t, M);
+
+			dbFreeNode(M);
+			dbFreeNode(N);
+			dbFreeNode(L);
+
+			return 1;
+		}
+
+		return dbConv(DB_R(t));
+
+	 case DB_APPL:
+		// aliases in the left-most position are substituted (see termConv)
+		while(DB_TYPE(DB_L(t)) == DB_ALIAS)
+			if(dbAliasSubst(DB_L(t)) != 0)
+				return -1;
+
+		if(DB_TYPE(DB_L(t)) != DB_ABSTR) {
+			r = dbConv(DB_L(t));
+			return r != 0
+				? r
+				: dbConv(DB_R(t));
+		}
+
+		// call-by-value application (defined with ~, or strict, see APPL_STRICT)
+		if(APPL_STRICT(DB_PRECED(t), getOption(OPT_STRATEGY) == STR_VALUE) &&
+			(r = dbConv(DB_R(t))) != 0)
+			return r;
+
+		// beta-reduction, no renaming is ever needed
+		L = DB_L(t);
+		M = DB_R(L);
+		N = DB_R(t);
+
+		used = 0;
+		res = dbSubst(M, 0, N, &used);
+		dbCopyNode(t, res);
+
+		dbFreeNode(res);
+		dbFreeNode(L);
+		if(!used)
+			dbFree(N);
+
+		return 1;
+
+	 case DB_ALIAS:
+		if(dbAliasSubst(t) != 0)
+			return -1;
+
+		return dbConv(t);
+
+	 default:
+		assert(0);
+		return -1;
+	}
+}
+
+
+// ------- Engine interface --------
+
+typedef struct {
+	DBTERM t;
+	TERM *shown;						// last term returned by dbTerm
+} DBSTATE;
+
+static void *dbStart(TERM *t) {
+	DBSTATE *st = arenaAlloc(sizeof(DBSTATE));
+
+	st->t = dbFromTerm(t);
+	st->shown = NULL;
+	return st;
+}
+
+static int dbStep(void *state) {
+	return dbConv(((DBSTATE*)state)->t);
+}
+
+static TERM *dbTerm(void *state) {
+	DBSTATE *st = state;
+
+	termFree(st->shown);
+	st->shown = dbToTerm(st->t);
+	return st->shown;
+}
+
+ENGINE dbEngine = { "debruijn", dbStart, dbStep, dbTerm, NULL };
@@ -0,0 +1,147 @@
+// vim:noet:ts=3
+
+/* Declarations for dbterm.c
+
+	Copyright (C) 2004-8 Kostas Chatzikokolakis
+	This file is part of LCI
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details. */
+
+#ifndef DBTERM_H
+#define DBTERM_H
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "grammar.h"
+#include "engine.h"
+#include "termalloc.h"
+#include "symbol.h"
+
+
+// Terms using de Bruijn indices. A bound variable is the number of binders
+// between the variable and the abstraction that binds it (0 = innermost), so
+// terms equal up to alpha-conversion are identical and substitution never needs
+// to rename. Free variables keep their name.
+
+enum dbterm_type_tag { DB_VAR, DB_FREE, DB_ABSTR, DB_APPL, DB_ALIAS } ATTR_PACKED;
+typedef enum dbterm_type_tag DBTERM_TYPE;
+
+#define DB_LOOSE_MAX		0xFFFF
+#define DB_STORE_INITSIZE	(64 * 1024)		// initial number of terms of a compact store
+
+// loose of a variable with index i, of an abstraction whose body has loose l
+// and of an application whose children have l and r
+#define LOOSE_VAR(i)		((i) + 1 < DB_LOOSE_MAX ? (i) + 1 : DB_LOOSE_MAX)
+#define LOOSE_ABSTR(l)	((l) == 0 ? 0 : (l) == DB_LOOSE_MAX ? DB_LOOSE_MAX : (l) - 1)
+#define LOOSE_APPL(l, r)	((l) > (r) ? (l) : (r))
+
+// loose is 1 + the largest index that points outside the term (0 if all
+// bound variables are bound inside the term). Like the closed flag of TERM it
+// might be larger than necessary but never smaller, and allows substitution
+// and shifting to skip whole subterms.
+//
+// Terms are accessed only through the DB_* macros, so that two representations
+// are possible. By default every term is a DBNODE and DBTERM is a pointer to it.
+// If COMPACT_TERMS is defined (configure --enable-compact-terms) the fields of
+// all terms are kept in parallel arrays (one set for each arena) and DBTERM is a
+// 32-bit handle: the top bit selects the arena, the rest is the index in the
+// arrays. Names are stored as symbol ids in the same field as indices, so a term
+// takes 16 bytes instead of 32 and traversals touch fewer cache lines.
+
+#ifndef COMPACT_TERMS
+
+typedef struct tag_dbterm {
+	struct tag_dbterm *lterm;				// function (applications)
+	struct tag_dbterm *rterm;				// argument (applications) or body (abstractions)
+	char *name;									// free variables, aliases and name hint of abstractions
+	int index;									// index of bound variables
+	unsigned short loose;
+	DBTERM_TYPE type;
+	unsigned char preced;
+} DBNODE;
+
+typedef DBNODE *DBTERM;
+
+#define DB_NULL				NULL
+#define DB_TYPE(t)			((t)->type)
+#define DB_PRECED(t)			((t)->preced)
+#define DB_LOOSE(t)			((t)->loose)
+#define DB_L(t)				((t)->lterm)
+#define DB_R(t)				((t)->rterm)
+#define DB_INDEX(t)			((t)->index)
+#define DB_NAME(t)			((t)->name)
+#define DB_SETNAME(t, n)	((t)->name = (n))
+
+#else
+
+typedef unsigned int DBTERM;
+
+typedef struct {
+	DBTERM_TYPE *type;
+	unsigned char *preced;
+	unsigned short *loose;
+	DBTERM *lterm, *rterm;
+	int *sym;									// index of bound variables, symbol id of names
+	unsigned int size, top;					// allocated and used entries (0 is never used)
+	DBTERM freeList;							// linked through lterm
+} DBSTORE;
+
+// bytes taken by one term of a compact store
+#define DB_NODE_SIZE			(sizeof(DBTERM_TYPE) + sizeof(unsigned char) + sizeof(unsigned short) + \
+									 2 * sizeof(DBTERM) + sizeof(int))
+
+extern DBSTORE dbStore[AR_NO];
+
+#define DB_NULL				0
+#define DB_ARENA(t)			((t) >> 31)
+#define DB_S(t)				(dbStore[DB_ARENA(t)])
+#define DB_I(t)				((t) & 0x7FFFFFFF)
+#define DB_TYPE(t)			(DB_S(t).type[DB_I(t)])
+#define DB_PRECED(t)			(DB_S(t).preced[DB_I(t)])
+#define DB_LOOSE(t)			(DB_S(t).loose[DB_I(t)])
+#define DB_L(t)				(DB_S(t).lterm[DB_I(t)])
+#define DB_R(t)				(DB_S(t).rterm[DB_I(t)])
+#define DB_INDEX(t)			(DB_S(t).sym[DB_I(t)])
+#define DB_NAME(t)			symbolName(DB_INDEX(t))
+#define DB_SETNAME(t, n)	(DB_INDEX(t) = symbolId(n))
+
+#endif
+
+// Note: dbNew may move the arrays of the compact store, so the result of a
+// function that allocates terms must be stored in a variable before it is
+// assigned to a field (in DB_L(t) = dbClone(...) the address of the field
+// could be computed before the call).
+
+
+DBTERM dbNew(DBTERM_TYPE type);
+void dbFree(DBTERM t);
+void dbFreeNode(DBTERM t);
+void dbGC();
+DBTERM dbNewVar(int index);
+DBTERM dbNewAbstr(char *name, DBTERM body);
+DBTERM dbNewAppl(DBTERM l, DBTERM r);
+DBTERM dbClone(DBTERM t, int shift, int cutoff);
+void dbShift(DBTERM t, int shift, int cutoff);
+
+DBTERM dbFromTerm(TERM *t);
+DBTERM dbFromTermDecimal(TERM *t);
+TERM *dbToTerm(DBTERM t);
+DBTERM dbFromDecl(char *id);
+
+int dbIsFree(DBTERM t, int index);
+int dbConv(DBTERM t);
+
+extern ENGINE dbEngine;
+
+
+#endif
@@ -26,39 +26,65 @@
 
 #include "decllist.h"
 #include "termproc.h"
+#include "symbol.h"
+#include "dbterm.h"
 #include "parser.h"
 
 
 DECL *declList = NULL;
+TERM *retired = NULL;				// replaced terms, freed by declReclaim
 
 
 // termAddDecl
 //
-// Adds the term to the declaration list with the given id.
+// Adds the term to the declaration list with the given (interned) id.
 // If a term with this id already exists it is replaced.
+//
+// Declarations must outlive the query that created them, so if term was not
+// allocated in the declaration arena it is moved there (a clone is stored and
+// term itself is freed). The stored term is shared (see termSetShared).
 
 void termAddDecl(char *id, TERM *term) {
 	DECL *decl;
+	ARENA_ID prev;
 
 	// declared term must be closed
 	assert(term->closed);
 
+	prev = arenaSelect(AR_DECL);
+
 	// if a declaration with this id exists, replace it
 	if((decl = getDecl(id))) {
-		//free declaration memory
-		free(decl->id);
-		termFree(decl->term);
+		// free declaration memory (when no query uses it anymore)
+		decl->term->name = (char*)retired;
+		retired = decl->term;
+		declFlush(decl);
+		decl->prim = -1;							// a builtin stands for the old term
 
 	} else {
 		// if declaration not found, create a new one
 		decl = malloc(sizeof(DECL));
 		decl->aliases.next = NULL;
+		decl->dbterm = DB_NULL;
+		decl->code = NULL;
+		decl->native = NULL;
+		decl->valueQuery = 0;
+		decl->prim = -1;
+		decl->strategy = DS_DEFAULT;
 		decl->next = declList;
 		declList = decl;
+		symbolSet(id, decl);
 	}
 
 	decl->id = id;
-	decl->term = term;
+	decl->term = prev == AR_DECL ? term : termClone(term);
+	termMarkStrategy(decl->term, decl);
+	termSetShared(decl->term, 1);
+
+	arenaSelect(prev);
+	if(prev != AR_DECL)
+		termFree(term);
+
 	buildAliasList(decl);
 }
 
@@ -66,15 +92,10 @@ void termAddDecl(char *id, TERM *term) {
 //
 // Returns a record corresponding to the declaration with
 // the given id, or NULL if there is no such declaration.
+// id must be interned, the declaration is the binding of its symbol.
 
 DECL *getDecl(char *id) {
-	DECL *decl;
-
-	for(decl = declList; decl; decl = decl->next)
-		if(strcmp(decl->id, id) == 0)
-			return decl;
-
-	return NULL;
+	return symbolGet(id);
 }
 
 // termFromDecl
@@ -89,6 +110,74 @@ TERM *termFromDecl(char *id) {
 		: NULL;
 }
 
+// declFlush
+//
+// Drops all forms of a declaration's term that are computed from it and
+// cached (must be called whenever decl->term changes).
+
+void declFlush(DECL *d) {
+	ARENA_ID prev = arenaSelect(AR_DECL);
+
+	if(d->dbterm) {
+		dbFree(d->dbterm);
+		d->dbterm = DB_NULL;
+	}
+	free(d->code);
+	d->code = NULL;
+	d->native = NULL;
+	d->valueQuery = 0;
+
+	arenaSelect(prev);
+}
+
+// declPrim
+//
+// Returns the builtin bound to d, or to the alias d is a synonym of ('+' = Plus),
+// -1 if there is none
+
+int declPrim(DECL *d) {
+	int hops;
+
+	for(hops = 0; d->prim == -1 && d->term->type == TM_ALIAS && hops < 64; hops++)
+		if(!(d = getDecl(d->term->name)))
+			return -1;
+
+	return d->prim;
+}
+
+// declSetStrategy
+//
+// Declares the strategy of d's calls and marks them in all declarations (see
+// termMarkStrategy)
+
+void declSetStrategy(DECL *d, DECL_STRATEGY strategy) {
+	DECL *decl;
+
+	d->strategy = strategy;
+
+	for(decl = declList; decl; decl = decl->next)
+		if(termMarkStrategy(decl->term, decl) > 0)
+			declFlush(decl);
+}
+
+// declReclaim
+//
+// Frees the terms of replaced declarations. Reduced terms share nodes with the
+// declarations, so this must wait until the query arena has been reset.
+
+void declReclaim() {
+	TERM *t;
+	ARENA_ID prev = arenaSelect(AR_DECL);
+
+	while((t = retired)) {
+		retired = (TERM*)t->name;
+		termSetShared(t, 0);
+		termFree(t);
+	}
+
+	arenaSelect(prev);
+}
+
 // buildAliasesList
 //
 // Deletes the old alias list and creates a new one
@@ -118,7 +207,7 @@ void buildAliasList(DECL *d) {
 
 int searchAliasList(IDLIST *list, char *id) {
 	for(list = list->next; list; list = list->next)
-		if(strcmp(list->id, id) == 0)
+		if(list->id == id)
 			return 1;
 
 	return 0;
@@ -133,12 +222,14 @@ void findAliases(TERM *t, IDLIST *list) {
 
 	switch(t->type) {
 	 case TM_VAR:
+	 case TM_NUM:
+	 case TM_LIST:
 		return;
 
 	 case TM_ALIAS:
 		if(!searchAliasList(list, t->name)) {
 			tmp = malloc(sizeof(IDLIST));
-			strcpy(tmp->id, t->name);
+			tmp->id = t->name;
 			tmp->next = list->next;
 			list->next = tmp;
 		}
@@ -267,7 +358,11 @@ void removeCycle(CYCLE c) {
 	char buffer[500],
 		  newId[50],
 		  *tmpId;
-	int i;
+	int i, prim;
+	ARENA_ID prev;
+
+	// all terms created here become part of declarations
+	prev = arenaSelect(AR_DECL);
 
 	// if there is more than one alias in the cycle, merge them in a tuple
 	if(c.size > 1) {
@@ -292,7 +387,7 @@ void removeCycle(CYCLE c) {
 		parse((void**)&t, TK_TERM);
 
 		termSetClosedFlag(t);				// mark sub-terms as closed
-		termAddDecl(strdup(newId), t);
+		termAddDecl(intern(newId), t);
 
 		// replace aliases with their corresponding terms
 		termRemoveAliases(t, NULL);
@@ -300,12 +395,14 @@ void removeCycle(CYCLE c) {
 		// Aliases contained in the cycle have been merged in a tuple.
 		// So their appearances are replaced by Index calls
 		for(i = 0, d = c.end; i < c.size; i++) {
-			tmpId = strdup(d->id);
+			tmpId = d->id;
 			d = d->prev;
 
 			tmpTerm = getIndexTerm(c.size, i, newId);
 			termSetClosedFlag(tmpTerm);
+			prim = getDecl(tmpId)->prim;			// the alias keeps its meaning
 			termAddDecl(tmpId, tmpTerm);
+			getDecl(tmpId)->prim = prim;
 
 			// replace this specific alias with its definition in the whole program
 			for(decl = declList; decl; decl = decl->next)
@@ -319,7 +416,7 @@ void removeCycle(CYCLE c) {
 	// To remove recursion, appearances of the alias within its body are replaced with the
 	// variable _me and we add a fixed point combinator.
 	// Hence the term A=N becomes A= \_me.N[A:=_me]
-	termAlias2Var(t, newId, "_me");							// Change alias to _me
+	termAlias2Var(t, intern(newId), intern("_me"));		// Change alias to _me
 
 	newTerm = termNew();											// Application of Y to the term
 	newTerm->type = TM_APPL;
@@ -327,7 +424,7 @@ void removeCycle(CYCLE c) {
 
 	newTerm->lterm = termNew();								// Y
 	newTerm->lterm->type = TM_ALIAS;
-	newTerm->lterm->name = strdup("Y");
+	newTerm->lterm->name = intern("Y");
 
 	newTerm->rterm = termNew();								// Remove \_me.
 	tmpTerm = newTerm->rterm;
@@ -337,17 +434,23 @@ void removeCycle(CYCLE c) {
 
 	tmpTerm->lterm = termNew();								// _me variable
 	tmpTerm->lterm->type = TM_VAR;
-	tmpTerm->lterm->name = strdup("_me");
+	tmpTerm->lterm->name = intern("_me");
 
 	// Change declaration
 	// Note: can't use termAddDecl because it frees the old term (used in the new one)
 	termSetClosedFlag(newTerm);
-	decl = getDecl(newId);
+	decl = getDecl(intern(newId));
 	decl->term = newTerm;
 
-	// reconstruct all alias lists
-	for(decl = declList; decl; decl = decl->next)
+	// reconstruct all alias lists, terms have changed so cached forms are dropped
+	// (and nodes modified or added above must become shared)
+	for(decl = declList; decl; decl = decl->next) {
 		buildAliasList(decl);	
+		declFlush(decl);
+		termSetShared(decl->term, 1);
+	}
+
+	arenaSelect(prev);
 }
 
 // getIndexTerm
@@ -21,16 +21,27 @@
 #endif
 
 #include "grammar.h"
+#include "dbterm.h"
 
 
 typedef struct tag_idlist {
-	char id[50];
+	char *id;								// interned
 	struct tag_idlist *next;
 } IDLIST;
 
+// strategy declared for an alias (see DefStrategy)
+typedef enum { DS_DEFAULT = 0, DS_STRICT, DS_LAZY } DECL_STRATEGY;
+
 typedef struct tag_decl {
-	char *id;
+	char *id;								// interned, its symbol is bound to the DECL
 	TERM *term;
+	DBTERM dbterm;							// de Bruijn form of term (cache, see dbFromDecl)
+	int *code;								// compiled term (cache, see bytecode.c)
+	void *native;							// native code of term (cache, see nativeCode)
+	void *value;							// engine's value of term in query valueQuery (see queryNo)
+	unsigned valueQuery;
+	int prim;								// builtin bound to the alias (see Prim), -1 if none
+	DECL_STRATEGY strategy;
 	struct tag_decl *next;
 	IDLIST aliases;
 
@@ -52,11 +63,17 @@ typedef struct {
 	int size;
 } CYCLE;
 
+extern DECL *declList;
+
 
 void termAddDecl(char *id, TERM *term);
 DECL *getDecl(char *id);
 TERM *termFromDecl(char *id);
 
+void declFlush(DECL *d);
+void declSetStrategy(DECL *d, DECL_STRATEGY strategy);
+int declPrim(DECL *d);
+void declReclaim();
 void buildAliasList(DECL *d);
 int searchAliasList(IDLIST *list, char *id);
 void findAliases(TERM *t, IDLIST *list);
@@ -0,0 +1,88 @@
+// vim:noet:ts=3
+
+/* Registry of reduction engines
+
+	Copyright (C) 2004-8 Kostas Chatzikokolakis
+	This file is part of LCI
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details. */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+
+#include "engine.h"
+#include "termproc.h"
+#include "dbterm.h"
+#include "krivine.h"
+#include "nbe.h"
+#include "bytecode.h"
+#include "optimal.h"
+#include "graph.h"
+#include "esubst.h"
+#include "ski.h"
+
+
+// The default engine works directly on the parsed term, performing at each
+// step the reduction termConv would, but continuing the search for it from
+// the previous one (see termConvNext).
+
+static void *treeStart(TERM *t) {
+	termConvStart(t);
+	return t;
+}
+
+static int treeStep(void *state) {
+	return termConvNext(state);
+}
+
+static TERM *treeTerm(void *state) {
+	return state;
+}
+
+ENGINE treeEngine = { "tree", treeStart, treeStep, treeTerm, NULL };
+
+// Number of the running query, increased by execTerm before the engine starts.
+// Engines use it to tell whether a value they keep in a DECL is still valid.
+unsigned queryNo = 0;
+
+// All available engines, the first one is the default
+ENGINE *engines[] = {
+	&treeEngine,
+	&dbEngine,
+	&krivineEngine,
+	&nbeEngine,
+	&bytecodeEngine,
+	&optimalEngine,
+	&graphEngine,
+	&esubstEngine,
+	&skiEngine,
+	NULL
+};
+
+
+// getEngine
+//
+// Returns the index of the engine with the given name, or -1 if there is
+// no such engine.
+
+int getEngine(char *name) {
+	int i;
+
+	for(i = 0; engines[i]; i++)
+		if(strcmp(engines[i]->name, name) == 0)
+			return i;
+
+	return -1;
+}
@@ -0,0 +1,53 @@
+// vim:noet:ts=3
+
+/* Declarations for engine.c
+
+	Copyright (C) 2004-8 Kostas Chatzikokolakis
+	This file is part of LCI
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details. */
+
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "grammar.h"
+
+// A reduction engine. execTerm hands the query to the selected engine's start
+// function and then calls step until the term is in normal form. term returns
+// the current term in the usual representation, the returned term belongs to
+// the engine and is valid until the next call of step or term. stats, if not
+// NULL, prints the engine's own figures next to the number of reductions.
+//
+// step returns
+// 	n	If n > 0 reductions were performed
+//		0	If the term is in normal form
+//		-1	If some error happened
+
+typedef struct {
+	char *name;
+	void *(*start)(TERM *t);
+	int (*step)(void *state);
+	TERM *(*term)(void *state);
+	void (*stats)(void *state);
+} ENGINE;
+
+extern ENGINE *engines[];
+extern unsigned queryNo;
+
+
+int getEngine(char *name);
+
+
+#endif
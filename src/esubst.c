@@ -0,0 +1,640 @@
+// vim:noet:ts=3
+
+/* Reduction with explicit substitutions
+
+	Copyright (C) 2004-8 Kostas Chatzikokolakis
+	This file is part of LCI
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details. */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include "esubst.h"
+#include "dbterm.h"
+#include "decllist.h"
+#include "termalloc.h"
+
+
+// Terms are in de Bruijn form with one more kind of node, a closure M[s] that
+// stands for M with substitution s applied to it (the lambda-upsilon calculus).
+// A beta-reduction (\.M) N only builds the closure M[N/], the substitution is
+// pushed into the term one node at a time when the reduction needs to look at
+// it:
+//		(M N)[s] -> M[s] N[s]			0[N/] -> N			0[^s] -> 0
+//		(\.M)[s] -> \.M[^s]				n+1[N/] -> n		n+1[^s] -> n[s][+1]
+//		M[s] -> M  if M is closed		n[+k] -> n+k
+// where N/ replaces index 0 by N, ^s (lift) is s under one more abstraction and
+// +k (shift) adds k to the indices. So substitutions never reach the parts of
+// the body that the normal form does not need, such as the branch of an If
+// that is not taken, or a closed subterm. A substitution is N/ or +k under j
+// lifts, kept in a single node, so that the value of an index is found at once
+// instead of going through the lifts one at a time.
+//
+// The reductions are performed in normal order, in place: a node is
+// overwritten with the result of its reduction (or with an indirection to an
+// existing node), so the meaning of a node never depends on where it is
+// referenced from and arguments are shared, not copied. Nodes that are in normal
+// form are marked so that they are not examined again. Like the other engines
+// the graph of a declaration is built once per query (see queryNo).
+//
+// The stack holds the frames of the computation, each one keeps the slot (the
+// pointer to the node) of:
+//		EF_ARG	an application of the spine, waiting for the abstraction in the head
+//		EF_LAM	an abstraction whose body is being normalized
+//		EF_APP	an application whose argument is being normalized (the remaining
+//					arguments are the EF_ARG frames below)
+
+typedef enum { EN_APP, EN_LAM, EN_VAR, EN_FREE, EN_ALIAS, EN_IND, EN_CLOS,
+					EN_SLASH, EN_LIFT, EN_SHIFT } ENODE_KIND;
+
+// l, r are the function and argument of applications, r the body of
+// abstractions, l the target of indirections, l the term and r the substitution
+// of closures, l the term of N/ and the lifted substitution of ^s, r the lift of
+// substitutions. index is the index of variables, k of +k or the number j of
+// lifts.
+typedef struct tag_enode {
+	ENODE_KIND kind;
+	char normal;
+	unsigned short loose;				// as in DBTERM
+	int index;
+	char *name;
+	struct tag_enode *l, *r;
+} ENODE;
+
+typedef enum { EF_ARG, EF_LAM, EF_APP } EFRAME_KIND;
+
+typedef struct {
+	EFRAME_KIND kind;
+	ENODE **slot;
+} EFRAME;
+
+// The machine reduces the node in slot (EM_EVAL) or has found its normal form
+// (EM_TERM).
+typedef enum { EM_EVAL, EM_TERM, EM_DONE } EMODE;
+
+typedef struct {
+	EMODE mode;
+	ENODE *root;
+	ENODE **slot;
+	int sp;									// frames in the stack
+	TERM *shown;							// last term returned by esubstTerm
+} ESTATE;
+
+static EFRAME *stack = NULL;
+static int stackSize = 0;
+
+
+// push
+//
+// Pushes a frame to the machine's stack and returns it
+
+static EFRAME *push(ESTATE *st, EFRAME_KIND kind) {
+	EFRAME *f;
+
+	if(st->sp == stackSize &&
+		!(stack = realloc(stack, (stackSize = stackSize ? 2 * stackSize : 1024) * sizeof(EFRAME)))) {
+		fprintf(stderr, "Error: out of memory.\n");
+		exit(1);
+	}
+
+	f = &stack[st->sp++];
+	f->kind = kind;
+	f->slot = st->slot;
+	return f;
+}
+
+// newNode
+//
+// Returns a new node of the given kind
+
+static ENODE *newNode(ENODE_KIND kind, ENODE *l, ENODE *r) {
+	ENODE *n = arenaAlloc(sizeof(ENODE));
+
+	n->kind = kind;
+	n->normal = 0;
+	n->loose = 0;
+	n->l = l;
+	n->r = r;
+	return n;
+}
+
+// newShift
+//
+// Returns substitution +k
+
+static ENODE *newShift(int k) {
+	ENODE *n = newNode(EN_SHIFT, NULL, NULL);
+
+	n->index = k;
+	return n;
+}
+
+// deref
+//
+// Returns the node that n refers to, following indirections
+
+static ENODE *deref(ENODE *n) {
+	while(n->kind == EN_IND)
+		n = n->l;
+	return n;
+}
+
+// looseSub
+//
+// Returns the loose of M[s], where M has loose l
+
+static unsigned short looseSub(unsigned short l, ENODE *s) {
+	int j = 0, r;
+
+	if(s->kind == EN_LIFT) {
+		j = s->index;
+		s = s->l;
+	}
+	if(l <= j || l == DB_LOOSE_MAX)
+		return l;
+
+	if(s->kind == EN_SHIFT)
+		r = l + s->index;
+	else {
+		r = s->l->loose + j;
+		r = LOOSE_APPL(l - 1, r);
+	}
+	return r < DB_LOOSE_MAX ? r : DB_LOOSE_MAX;
+}
+
+// setClos
+//
+// Makes n the closure t[s], or an indirection to t if t is closed
+
+static void setClos(ENODE *n, ENODE *t, ENODE *s) {
+	if(t->loose == 0) {
+		n->kind = EN_IND;
+		n->l = t;
+		return;
+	}
+
+	n->kind = EN_CLOS;
+	n->l = t;
+	n->r = s;
+	n->loose = looseSub(t->loose, s);
+}
+
+// newClos
+//
+// Returns the closure t[s] (t itself if it is closed)
+
+static ENODE *newClos(ENODE *t, ENODE *s) {
+	ENODE *n;
+
+	if(t->loose == 0)
+		return t;
+
+	n = newNode(EN_CLOS, NULL, NULL);
+	setClos(n, t, s);
+	return n;
+}
+
+// setVar
+//
+// Makes n variable i
+
+static void setVar(ENODE *n, int i) {
+	n->kind = EN_VAR;
+	n->index = i;
+	n->loose = LOOSE_VAR(i);
+}
+
+// newLift
+//
+// Returns ^s, which is built once and kept in s->r
+
+static ENODE *newLift(ENODE *s) {
+	ENODE *n;
+
+	if(s->r)
+		return s->r;
+
+	if(s->kind == EN_LIFT) {
+		n = newNode(EN_LIFT, s->l, NULL);
+		n->index = s->index + 1;
+	} else {
+		n = newNode(EN_LIFT, s, NULL);
+		n->index = 1;
+	}
+	return s->r = n;
+}
+
+// setSubVar
+//
+// Makes n the value of index i under substitution s
+
+static void setSubVar(ENODE *n, ENODE *s, int i) {
+	int j = 0;
+
+	if(s->kind == EN_LIFT) {
+		j = s->index;
+		s = s->l;
+	}
+
+	if(i < j)
+		setVar(n, i);
+	else if(s->kind == EN_SHIFT)
+		setVar(n, i + s->index);
+	else if(i > j)
+		setVar(n, i - 1);
+	else if(j == 0) {
+		n->kind = EN_IND;
+		n->l = s->l;
+	} else
+		setClos(n, s->l, newShift(j));
+}
+
+// expose
+//
+// Pushes the substitution of closure n into its term, until the top node of n
+// is not a closure.
+
+static void expose(ENODE *n) {
+	ENODE *m, *s, *l, *r;
+
+	while(n->kind == EN_CLOS) {
+		m = deref(n->l);
+		s = n->r;
+
+		// the term became closed after the closure was built
+		if(m->loose == 0) {
+			n->kind = EN_IND;
+			n->l = m;
+			break;
+		}
+
+		switch(m->kind) {
+		 case EN_CLOS:
+			// M[+j][+k] -> M[+j+k], otherwise the inner closure goes first
+			if(s->kind == EN_SHIFT && m->r->kind == EN_SHIFT) {
+				l = m->l;
+				r = newShift(m->r->index + s->index);
+				setClos(n, l, r);
+			} else
+				expose(m);
+			break;
+
+		 case EN_APP:
+			l = newClos(m->l, s);
+			r = newClos(m->r, s);
+			n->kind = EN_APP;
+			n->l = l;
+			n->r = r;
+			n->loose = LOOSE_APPL(l->loose, r->loose);
+			break;
+
+		 case EN_LAM:
+			r = newLift(s);
+			r = newClos(m->r, r);
+			n->kind = EN_LAM;
+			n->name = m->name;
+			n->l = NULL;
+			n->r = r;
+			n->loose = LOOSE_ABSTR(r->loose);
+			break;
+
+		 case EN_VAR:
+			setSubVar(n, s, m->index);
+			break;
+
+		 default:
+			// free variables and aliases are closed
+			assert(0);
+			return;
+		}
+	}
+}
+
+// isFree
+//
+// Returns 1 if index is free in t (which is in normal form)
+
+static int isFree(ENODE *t, int index) {
+	t = deref(t);
+	if(t->loose <= index)
+		return 0;
+
+	switch(t->kind) {
+	 case EN_VAR:
+		return t->index == index;
+	 case EN_LAM:
+		return isFree(t->r, index + 1);
+	 case EN_APP:
+		return isFree(t->l, index) || isFree(t->r, index);
+	 default:
+		return 0;
+	}
+}
+
+// fromDb
+//
+// Returns the node of term t
+
+static ENODE *fromDb(DBTERM t) {
+	ENODE *n, *l, *r;
+
+	switch(DB_TYPE(t)) {
+	 case DB_APPL:
+		l = fromDb(DB_L(t));
+		r = fromDb(DB_R(t));
+		n = newNode(EN_APP, l, r);
+		break;
+
+	 case DB_ABSTR:
+		r = fromDb(DB_R(t));
+		n = newNode(EN_LAM, NULL, r);
+		n->name = DB_NAME(t);
+		break;
+
+	 case DB_VAR:
+		n = newNode(EN_VAR, NULL, NULL);
+		n->index = DB_INDEX(t);
+		break;
+
+	 default:
+		n = newNode(DB_TYPE(t) == DB_FREE ? EN_FREE : EN_ALIAS, NULL, NULL);
+		n->name = DB_NAME(t);
+	}
+
+	n->loose = DB_LOOSE(t);
+	return n;
+}
+
+// aliasNode
+//
+// Returns the node of the declaration with the given id, built once per query
+
+static ENODE *aliasNode(char *id) {
+	DECL *decl = getDecl(id);
+
+	if(!decl) {
+		printf("Error: Alias %s is not declared.\n", id);
+		return NULL;
+	}
+
+	if(decl->valueQuery != queryNo) {
+		decl->value = fromDb(dbFromDecl(id));
+		decl->valueQuery = queryNo;
+	}
+	return decl->value;
+}
+
+// readArg
+//
+// Continues with the normalization of the argument of EF_ARG frame f
+
+static void readArg(ESTATE *st, EFRAME *f) {
+	f->kind = EF_APP;
+	st->slot = &(*f->slot)->r;
+	st->mode = EM_EVAL;
+}
+
+// esubstStep
+//
+// Runs the machine until a beta-reduction is performed (returns 1) or the
+// normal form is found (returns 0). Returns -1 if an undeclared alias is met.
+
+static int esubstStep(void *state) {
+	ESTATE *st = state;
+	EFRAME *f;
+	ENODE *n, *a, *b;
+
+	for(;;) switch(st->mode) {
+	 case EM_EVAL:
+		n = *st->slot;
+		f = st->sp ? &stack[st->sp - 1] : NULL;
+
+		// the head of the spine is a variable, or a neutral term already in
+		// normal form, its arguments are normalized in turn (first one first)
+		if(n->kind == EN_VAR || n->kind == EN_FREE ||
+			(n->normal && n->kind == EN_APP)) {
+			n->normal = 1;
+			if(f && f->kind == EF_ARG)
+				readArg(st, f);
+			else
+				st->mode = EM_TERM;
+			break;
+		}
+
+		switch(n->kind) {
+		 case EN_IND:
+			*st->slot = n->l;
+			break;
+
+		 case EN_CLOS:
+			expose(n);
+			break;
+
+		 case EN_ALIAS:
+			if(!(a = aliasNode(n->name)))
+				return -1;
+			n->kind = EN_IND;
+			n->l = a;
+			break;
+
+		 case EN_APP:
+			push(st, EF_ARG);
+			st->slot = &n->l;
+			break;
+
+		 case EN_LAM:
+			// beta-reduction, (\.M) N -> M[N/]
+			if(f && f->kind == EF_ARG) {
+				a = *f->slot;
+				b = newNode(EN_SLASH, a->r, NULL);
+				setClos(a, n->r, b);
+
+				st->slot = f->slot;
+				st->sp--;
+				return 1;
+			}
+
+			if(n->normal)
+				st->mode = EM_TERM;
+			else {
+				push(st, EF_LAM);
+				st->slot = &n->r;
+			}
+			break;
+
+		 default:
+			assert(0);
+			return -1;
+		}
+		break;
+
+	 case EM_TERM:
+		if(!st->sp) {
+			st->mode = EM_DONE;
+			return 0;
+		}
+
+		f = &stack[st->sp - 1];
+		st->slot = f->slot;
+		st->sp--;
+		n = *st->slot;
+
+		if(f->kind == EF_LAM) {
+			// eta-reduction, \.M 0 -> M[-1]  if 0 not free in M
+			b = deref(n->r);
+			if(b->kind == EN_APP &&
+				(a = deref(b->r))->kind == EN_VAR &&
+				a->index == 0 &&
+				!isFree(b->l, 0)) {
+
+				setClos(n, b->l, newShift(-1));
+				st->mode = EM_EVAL;
+			} else
+				n->normal = 1;
+
+		} else {
+			assert(f->kind == EF_APP);
+			n->normal = 1;
+
+			if(st->sp && (f = &stack[st->sp - 1])->kind == EF_ARG)
+				readArg(st, f);
+		}
+		break;
+
+	 case EM_DONE:
+		return 0;
+	}
+}
+
+// unload, applySub, subVar
+//
+// Return the term of node n, the term t (under k abstractions of the term the
+// substitution applies to) with substitution s applied, and the term that s
+// gives to index i. Used to display the terms, shared nodes are unloaded once
+// for every reference.
+
+static DBTERM unload(ENODE *n);
+
+static DBTERM subVar(ENODE *s, int i) {
+	DBTERM t;
+	int j = 0;
+
+	if(s->kind == EN_LIFT) {
+		j = s->index;
+		s = s->l;
+	}
+
+	if(i < j)
+		return dbNewVar(i);
+	if(s->kind == EN_SHIFT)
+		return dbNewVar(i + s->index);
+	if(i > j)
+		return dbNewVar(i - 1);
+
+	t = unload(s->l);
+	dbShift(t, j, 0);
+	return t;
+}
+
+static DBTERM applySub(DBTERM t, ENODE *s, int k) {
+	DBTERM l, r;
+	char *name;
+	int i;
+
+	switch(DB_TYPE(t)) {
+	 case DB_VAR:
+		if((i = DB_INDEX(t)) < k)
+			return t;
+		dbFreeNode(t);
+		r = subVar(s, i - k);
+		dbShift(r, k, 0);
+		return r;
+
+	 case DB_ABSTR:
+		name = DB_NAME(t);
+		r = applySub(DB_R(t), s, k + 1);
+		dbFreeNode(t);
+		return dbNewAbstr(name, r);
+
+	 case DB_APPL:
+		l = applySub(DB_L(t), s, k);
+		r = applySub(DB_R(t), s, k);
+		dbFreeNode(t);
+		return dbNewAppl(l, r);
+
+	 default:
+		return t;
+	}
+}
+
+static DBTERM unload(ENODE *n) {
+	DBTERM t, l, r;
+
+	n = deref(n);
+
+	switch(n->kind) {
+	 case EN_VAR:
+		return dbNewVar(n->index);
+
+	 case EN_LAM:
+		r = unload(n->r);
+		return dbNewAbstr(n->name, r);
+
+	 case EN_APP:
+		l = unload(n->l);
+		r = unload(n->r);
+		return dbNewAppl(l, r);
+
+	 case EN_CLOS:
+		t = unload(n->l);
+		return applySub(t, n->r, 0);
+
+	 default:
+		t = dbNew(n->kind == EN_FREE ? DB_FREE : DB_ALIAS);
+		DB_SETNAME(t, n->name);
+		return t;
+	}
+}
+
+
+// ------- Engine interface --------
+
+static void *esubstStart(TERM *t) {
+	ESTATE *st = arenaAlloc(sizeof(ESTATE));
+
+	st->mode = EM_EVAL;
+	st->root = fromDb(dbFromTerm(t));
+	st->slot = &st->root;
+	st->sp = 0;
+	st->shown = NULL;
+	return st;
+}
+
+// esubstTerm
+//
+// Returns the term being reduced (the normal form once it is found), with
+// the pending substitutions applied.
+
+static TERM *esubstTerm(void *state) {
+	ESTATE *st = state;
+
+	termFree(st->shown);
+	st->shown = dbToTerm(unload(st->root));
+	return st->shown;
+}
+
+ENGINE esubstEngine = { "esubst", esubstStart, esubstStep, esubstTerm, NULL };
@@ -27,6 +27,7 @@
 #include "parser.h"
 #include "grammar.h"
 #include "termproc.h"
+#include "symbol.h"
 #include "decllist.h"
 #include "run.h"
 
@@ -218,7 +219,7 @@ void procRule0(SYMB_INFO *symb) {
 	termSetClosedFlag($(2));
 
 	if( ((TERM*)$(2))->closed )
-		termAddDecl(strdup(removeChar($(0), '\'')), $(2));
+		termAddDecl(intern(removeChar($(0), '\'')), $(2));
 	else
 		fprintf(stderr, "Error: alias %s is not a closed term and won't be registered\n", $(0));
 
@@ -243,28 +244,28 @@ void procRule1(SYMB_INFO *symb) {
 void procRule2(SYMB_INFO *symb) {
 	TERM *s = termNew();
 	s->type = TM_VAR;
-	s->name = strdup($(0));
+	s->name = intern($(0));
 
 	$$ = newAppl(s, $(1));
 }
 
 // T -> num T'
 void procRule3(SYMB_INFO *symb) {
-	int num = 0;
+	TERM *s = termNew();
 
-	if(strlen($(0)) > 5)
-		fprintf(stderr, "Error: naturals must be in the range 0-99999.\n");
+	if(strlen($(0)) < BIG_DECIMALS)
+		termSetNumeral(s, atoi($(0)), NULL);
 	else
-		num = atoi($(0));
+		termSetNumeral(s, 0, bigFromString($(0)));
 
-	$$ = newAppl(termChurchNum(num), $(1));
+	$$ = newAppl(s, $(1));
 }
 
 // T -> id T'
 void procRule4(SYMB_INFO *symb) {
 	TERM *s = termNew();
 	s->type = TM_ALIAS;
-	s->name = strdup(removeChar($(0), '\''));
+	s->name = intern(removeChar($(0), '\''));
 
 	$$ = newAppl(s, $(1));
 }
@@ -281,7 +282,7 @@ void procRule6(SYMB_INFO *symb) {
 		  *v = termNew();
 
 	v->type = TM_VAR;
-	v->name = strdup($(1));
+	v->name = intern($(1));
 
 	s->type = TM_ABSTR;
 	s->lterm = v;
@@ -324,7 +325,7 @@ void procRule11(SYMB_INFO *symb) {
 
 // OPER -> op
 void procRule13(SYMB_INFO *symb) {
-	$$ = strdup($(0));
+	$$ = intern($(0));
 }
 
 // Simply sets $$ to NULL
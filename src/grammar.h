@@ -72,7 +72,7 @@ typedef enum {
 
 // Note: ATTR_PACKED (#defined __atribute__((packed))) instructs the compiler to
 // use 1 byte instead of 4 for the enum
-enum term_type_tag { TM_ABSTR, TM_APPL, TM_VAR, TM_ALIAS } ATTR_PACKED;
+enum term_type_tag { TM_ABSTR, TM_APPL, TM_VAR, TM_ALIAS, TM_NUM, TM_LIST } ATTR_PACKED;
 enum ass_type_tag { ASS_LEFT, ASS_RIGHT, ASS_NONE } ATTR_PACKED;
 
 typedef enum term_type_tag TERM_TYPE;
@@ -84,13 +84,23 @@ typedef enum { CM_QUEST, CM_DECL } COMMAND_TYPE;
 // results in a smaller sizeof(TERM)
 //
 typedef struct term_tag {
-	struct term_tag *lterm;					// left and right children
-	struct term_tag *rterm;					// (for applications and abstractions)
+	union {
+		struct term_tag *lterm;				// left and right children
+		struct tag_bignum *big;				// value of numerals that do not fit in num (see number.h)
+		struct tag_list *list;				// elements of packed lists (see packed.h)
+	};
+	union {
+		struct term_tag *rterm;				// (for applications and abstractions)
+		int num;									// value of numerals (Church numeral \f.\x.f^num(x)) if big is NULL
+	};
 	char *name;									// name (for variables, aliases and applications with an operator)
-	TERM_TYPE type;							// variable, application or abstraction
+	TERM_TYPE type;							// variable, application, abstraction, alias, numeral or list
 	ASS_TYPE assoc;
 	unsigned char preced;
 	char closed;
+	char shared;								// used in many places, never modified in place
+												// (2 if it is also known to be in normal form)
+	unsigned short refs;						// number of references to a shared term
 } TERM;
 
 typedef struct command_tag {
@@ -0,0 +1,474 @@
+// vim:noet:ts=3
+
+/* Graph reduction with indirection nodes
+
+	Copyright (C) 2004-8 Kostas Chatzikokolakis
+	This file is part of LCI
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details. */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include "graph.h"
+#include "dbterm.h"
+#include "decllist.h"
+#include "termalloc.h"
+
+
+// The term is a graph (in de Bruijn form), a node can be referenced by many
+// others. A beta-reduction builds an instance of the body of the abstraction
+// with the argument plugged in, where the argument is never copied and neither
+// are the subterms of the body that do not contain the variable. The redex is
+// then overwritten with the result, or with an indirection to it when the
+// result is a node that already exists, so all references to the redex see the
+// reduction and it is never performed twice.
+//
+// The graph of a declaration is built once per query (kept in the DECL, see
+// queryNo) and reduced in place like the rest, so its redexes are shared by all
+// its uses too.
+//
+// The spine of the term is unwound on a stack until an abstraction is found in
+// the head, each step performs one reduction. A term in weak head normal form
+// is read back like in the krivine engine: the body of an abstraction is
+// instantiated with a hole (a variable identified by the level of its
+// abstraction, counted from the root) and the arguments of a variable are read
+// back in turn. So the terms being reduced never have loose indices and only
+// nodes with no loose indices are ever overwritten.
+//
+// The stack holds the frames of the computation:
+//		GF_ARG	an application of the spine, waiting for the abstraction in the head
+//		GF_LAM	the body of abstraction n is being read back (depth is its depth)
+//		GF_APP	the argument of application n is being read back, t is the normal
+//					form of the function (the remaining arguments are the GF_ARG
+//					frames below)
+
+typedef enum { GN_APP, GN_LAM, GN_VAR, GN_IND, GN_FREE, GN_ALIAS, GN_HOLE } GNODE_KIND;
+
+// l, r are the function and argument of applications, r the body of
+// abstractions, l the target of indirections. index is the index of variables
+// or the level of holes.
+typedef struct tag_gnode {
+	GNODE_KIND kind;
+	unsigned short loose;				// as in DBTERM
+	int index;
+	char *name;
+	struct tag_gnode *l, *r;
+} GNODE;
+
+typedef enum { GF_ARG, GF_LAM, GF_APP } GFRAME_KIND;
+
+typedef struct {
+	GFRAME_KIND kind;
+	int depth;
+	GNODE *n;
+	DBTERM t;
+} GFRAME;
+
+// The machine reduces node (GM_EVAL) or returns the normal form res (GM_TERM).
+// depth is the number of abstractions above the term being read back.
+typedef enum { GM_EVAL, GM_TERM, GM_DONE } GMODE;
+
+typedef struct {
+	GMODE mode;
+	GNODE *node;
+	DBTERM res;
+	int depth;
+	int sp;									// frames in the stack
+	TERM *shown;							// last term returned by graphTerm
+} GSTATE;
+
+static GFRAME *stack = NULL;
+static int stackSize = 0;
+
+
+// push
+//
+// Pushes a frame to the machine's stack and returns it
+
+static GFRAME *push(GSTATE *st, GFRAME_KIND kind) {
+	GFRAME *f;
+
+	if(st->sp == stackSize &&
+		!(stack = realloc(stack, (stackSize = stackSize ? 2 * stackSize : 1024) * sizeof(GFRAME)))) {
+		fprintf(stderr, "Error: out of memory.\n");
+		exit(1);
+	}
+
+	f = &stack[st->sp++];
+	f->kind = kind;
+	return f;
+}
+
+// newNode
+//
+// Returns a new node of the given kind
+
+static GNODE *newNode(GNODE_KIND kind, GNODE *l, GNODE *r) {
+	GNODE *n = arenaAlloc(sizeof(GNODE));
+
+	n->kind = kind;
+	n->loose = 0;
+	n->l = l;
+	n->r = r;
+	return n;
+}
+
+// fromDb
+//
+// Returns the graph of term t (a tree, nothing is shared yet)
+
+static GNODE *fromDb(DBTERM t) {
+	GNODE *n, *l, *r;
+
+	switch(DB_TYPE(t)) {
+	 case DB_APPL:
+		l = fromDb(DB_L(t));
+		r = fromDb(DB_R(t));
+		n = newNode(GN_APP, l, r);
+		break;
+
+	 case DB_ABSTR:
+		r = fromDb(DB_R(t));
+		n = newNode(GN_LAM, NULL, r);
+		n->name = DB_NAME(t);
+		break;
+
+	 case DB_VAR:
+		n = newNode(GN_VAR, NULL, NULL);
+		n->index = DB_INDEX(t);
+		break;
+
+	 default:
+		n = newNode(DB_TYPE(t) == DB_FREE ? GN_FREE : GN_ALIAS, NULL, NULL);
+		n->name = DB_NAME(t);
+	}
+
+	n->loose = DB_LOOSE(t);
+	return n;
+}
+
+// instantiate
+//
+// Returns an instance of t (placed under k abstractions of the body being
+// instantiated) where index k is replaced by arg. Subterms that do not contain
+// index k are shared. arg has no loose indices, so it needs no shifting, and
+// the abstraction has none either, so t contains no index larger than k.
+
+static GNODE *instantiate(GNODE *t, GNODE *arg, int k) {
+	GNODE *n, *l, *r;
+
+	while(t->kind == GN_IND)
+		t = t->l;
+
+	if(t->loose <= k)
+		return t;
+
+	switch(t->kind) {
+	 case GN_VAR:
+		assert(t->index == k);
+		return arg;
+
+	 case GN_LAM:
+		r = instantiate(t->r, arg, k + 1);
+		n = newNode(GN_LAM, NULL, r);
+		n->name = t->name;
+		n->loose = LOOSE_ABSTR(r->loose);
+		return n;
+
+	 case GN_APP:
+		l = instantiate(t->l, arg, k);
+		r = instantiate(t->r, arg, k);
+		n = newNode(GN_APP, l, r);
+		n->loose = LOOSE_APPL(l->loose, r->loose);
+		return n;
+
+	 default:
+		assert(0);
+		return t;
+	}
+}
+
+// aliasGraph
+//
+// Returns the graph of the declaration with the given id, built once per query
+
+static GNODE *aliasGraph(char *id) {
+	DECL *decl = getDecl(id);
+
+	if(!decl) {
+		printf("Error: Alias %s is not declared.\n", id);
+		return NULL;
+	}
+
+	if(decl->valueQuery != queryNo) {
+		decl->value = fromDb(dbFromDecl(id));
+		decl->valueQuery = queryNo;
+	}
+	return decl->value;
+}
+
+// newHead
+//
+// Returns the head of a neutral term (a free variable or a hole), read back at
+// the given depth
+
+static DBTERM newHead(GNODE *n, int depth) {
+	DBTERM t;
+
+	if(n->kind == GN_HOLE)
+		return dbNewVar(depth - 1 - n->index);
+
+	t = dbNew(DB_FREE);
+	DB_SETNAME(t, n->name);
+	return t;
+}
+
+// readArg
+//
+// Continues with the readback of the argument of GF_ARG frame f, t is the
+// normal form of the function
+
+static void readArg(GSTATE *st, GFRAME *f, DBTERM t) {
+	f->kind = GF_APP;
+	f->t = t;
+	f->depth = st->depth;
+
+	st->node = f->n->r;
+	st->mode = GM_EVAL;
+}
+
+// graphStep
+//
+// Runs the machine until a beta-reduction is performed (returns 1) or the
+// normal form is found (returns 0). Returns -1 if an undeclared alias is met.
+
+static int graphStep(void *state) {
+	GSTATE *st = state;
+	GFRAME *f;
+	GNODE *n, *a, *res, *body;
+	DBTERM t, nf;
+
+	for(;;) switch(st->mode) {
+	 case GM_EVAL:
+		n = st->node;
+		f = st->sp ? &stack[st->sp - 1] : NULL;
+
+		switch(n->kind) {
+		 case GN_IND:
+			// the application in the spine is shortcut as well
+			st->node = n->l;
+			if(f && f->kind == GF_ARG && f->n->l == n)
+				f->n->l = n->l;
+			break;
+
+		 case GN_APP:
+			push(st, GF_ARG)->n = n;
+			st->node = n->l;
+			break;
+
+		 case GN_ALIAS:
+			if(!(a = aliasGraph(n->name)))
+				return -1;
+			n->kind = GN_IND;
+			n->l = a;
+			break;
+
+		 case GN_LAM:
+			// beta-reduction, the redex becomes the result
+			if(f && f->kind == GF_ARG) {
+				a = f->n;
+				for(body = n->r; body->kind == GN_IND; body = body->l)
+					;
+				res = instantiate(body, a->r, 0);
+
+				// the instance is a new node unless it is the argument or the
+				// body itself
+				if(body->loose && body->kind != GN_VAR)
+					*a = *res;
+				else {
+					a->kind = GN_IND;
+					a->l = res;
+					a->r = NULL;
+				}
+
+				st->node = a;
+				st->sp--;
+				return 1;
+			}
+
+			// weak head normal form, the body is read back with the variable
+			// replaced by a hole
+			f = push(st, GF_LAM);
+			f->n = n;
+			f->depth = ++st->depth;
+
+			a = newNode(GN_HOLE, NULL, NULL);
+			a->index = st->depth - 1;
+			st->node = instantiate(n->r, a, 0);
+			break;
+
+		 case GN_FREE:
+		 case GN_HOLE:
+			// read back the arguments, first one first
+			st->res = newHead(n, st->depth);
+			if(f && f->kind == GF_ARG)
+				readArg(st, f, st->res);
+			else
+				st->mode = GM_TERM;
+			break;
+
+		 default:
+			assert(0);
+			return -1;
+		}
+		break;
+
+	 case GM_TERM:
+		if(!st->sp) {
+			st->mode = GM_DONE;
+			return 0;
+		}
+
+		f = &stack[st->sp - 1];
+		nf = st->res;
+
+		if(f->kind == GF_LAM) {
+			// eta-reduction, \.M 0 -> M  if 0 not free in M
+			if(DB_TYPE(nf) == DB_APPL &&
+				DB_TYPE(DB_R(nf)) == DB_VAR &&
+				DB_INDEX(DB_R(nf)) == 0 &&
+				!dbIsFree(DB_L(nf), 0)) {
+
+				st->res = DB_L(nf);
+				dbShift(st->res, -1, 0);
+				dbFreeNode(DB_R(nf));
+				dbFreeNode(nf);
+			} else
+				st->res = dbNewAbstr(f->n->name, nf);
+
+			st->depth = f->depth - 1;
+			st->sp--;
+
+		} else {
+			assert(f->kind == GF_APP);
+			t = dbNewAppl(f->t, nf);
+			st->depth = f->depth;
+			st->sp--;
+
+			if(st->sp && (f = &stack[st->sp - 1])->kind == GF_ARG)
+				readArg(st, f, t);
+			else
+				st->res = t;
+		}
+		break;
+
+	 case GM_DONE:
+		return 0;
+	}
+}
+
+// unload
+//
+// Returns the term of node n, placed under depth abstractions (k of which are
+// inside n). Used to display the state of the machine, shared nodes are
+// unloaded once for every reference.
+
+static DBTERM unload(GNODE *n, int depth, int k) {
+	DBTERM t, l, r;
+
+	while(n->kind == GN_IND)
+		n = n->l;
+
+	switch(n->kind) {
+	 case GN_VAR:
+		return dbNewVar(n->index);
+
+	 case GN_HOLE:
+		return newHead(n, depth + k);
+
+	 case GN_LAM:
+		r = unload(n->r, depth, k + 1);
+		return dbNewAbstr(n->name, r);
+
+	 case GN_APP:
+		l = unload(n->l, depth, k);
+		r = unload(n->r, depth, k);
+		return dbNewAppl(l, r);
+
+	 default:
+		t = dbNew(n->kind == GN_FREE ? DB_FREE : DB_ALIAS);
+		DB_SETNAME(t, n->name);
+		return t;
+	}
+}
+
+
+// ------- Engine interface --------
+
+static void *graphStart(TERM *t) {
+	GSTATE *st = arenaAlloc(sizeof(GSTATE));
+
+	st->mode = GM_EVAL;
+	st->node = fromDb(dbFromTerm(t));
+	st->depth = 0;
+	st->sp = 0;
+	st->shown = NULL;
+	return st;
+}
+
+// graphTerm
+//
+// Returns the normal form, or while the machine runs the term it represents:
+// the node being reduced with the frames of the stack (from the top) wrapped
+// around it.
+
+static TERM *graphTerm(void *state) {
+	GSTATE *st = state;
+	GFRAME *f;
+	DBTERM t, r;
+	int i, depth = st->depth;
+
+	t = st->mode == GM_EVAL
+		? unload(st->node, depth, 0)
+		: st->res;
+
+	for(i = st->sp - 1; i >= 0; i--) {
+		f = &stack[i];
+
+		switch(f->kind) {
+		 case GF_ARG:
+			r = unload(f->n->r, depth, 0);
+			t = dbNewAppl(t, r);
+			break;
+
+		 case GF_LAM:
+			t = dbNewAbstr(f->n->name, t);
+			depth = f->depth - 1;
+			break;
+
+		 case GF_APP:
+			t = dbNewAppl(f->t, t);
+			break;
+		}
+	}
+
+	termFree(st->shown);
+	st->shown = dbToTerm(t);
+	return st->shown;
+}
+
+ENGINE graphEngine = { "graph", graphStart, graphStep, graphTerm, NULL };
@@ -0,0 +1,31 @@
+// vim:noet:ts=3
+
+/* Declarations for graph.c
+
+	Copyright (C) 2004-8 Kostas Chatzikokolakis
+	This file is part of LCI
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details. */
+
+#ifndef GRAPH_H
+#define GRAPH_H
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "engine.h"
+
+
+extern ENGINE graphEngine;
+
+
+#endif
@@ -0,0 +1,465 @@
+// vim:noet:ts=3
+
+/* Lazy Krivine machine
+
+	Copyright (C) 2004-8 Kostas Chatzikokolakis
+	This file is part of LCI
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details. */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include "krivine.h"
+#include "termalloc.h"
+
+
+// The machine never substitutes, a beta-reduction only adds the argument to the
+// environment of the body. Terms are evaluated to weak head normal form (the
+// head of the stack is an abstraction with no arguments left, or a variable),
+// then read back: the body of an abstraction is evaluated with its variable
+// bound to a neutral value and the arguments of a variable are read back in
+// turn. Readback is done by the machine itself, so there is no recursion and a
+// computation can be suspended after each reduction (each step performs one).
+//
+// The code is the de Bruijn form of the query and of the declarations (cached
+// in the DECL, see dbFromDecl), only the normal form is built as a new term.
+// Closures and environments are never freed before the end of the query.
+//
+// The stack holds the frames of the computation:
+//		KF_ARG	an argument waiting for the abstraction in the head
+//		KF_UPD	a thunk being evaluated, updated when its value is found
+//		KF_LAM	the body of an abstraction is being read back (n is its depth)
+//		KF_APP	the arguments of a neutral value are being read back, t is the
+//					normal form so far, l the arguments left (first one first)
+
+typedef enum { KF_ARG, KF_UPD, KF_LAM, KF_APP } KFRAME_KIND;
+
+typedef struct {
+	KFRAME_KIND kind;
+	int n;
+	KCLOS *c;
+	KENV *l;
+	DBTERM t;
+} KFRAME;
+
+// The machine evaluates code in env (KM_EVAL), returns the neutral value val
+// (KM_VALUE) or returns the normal form res (KM_TERM). depth is the number of
+// abstractions above the term being read back.
+typedef enum { KM_EVAL, KM_VALUE, KM_TERM, KM_DONE } KMODE;
+
+typedef struct {
+	KMODE mode;
+	DBTERM code;
+	KENV *env;
+	KCLOS *val;
+	DBTERM res;
+	int depth;
+	int sp;									// frames in the stack
+	TERM *shown;							// last term returned by krivineTerm
+} KSTATE;
+
+static KFRAME *stack = NULL;
+static int stackSize = 0;
+
+
+// push
+//
+// Pushes a frame to the machine's stack and returns it
+
+static KFRAME *push(KSTATE *st, KFRAME_KIND kind) {
+	KFRAME *f;
+
+	if(st->sp == stackSize &&
+		!(stack = realloc(stack, (stackSize = stackSize ? 2 * stackSize : 1024) * sizeof(KFRAME)))) {
+		fprintf(stderr, "Error: out of memory.\n");
+		exit(1);
+	}
+
+	f = &stack[st->sp++];
+	f->kind = kind;
+	return f;
+}
+
+// newEnv
+//
+// Returns the environment env extended with c (which gets index 0)
+
+static KENV *newEnv(KCLOS *c, KENV *env) {
+	KENV *e = arenaAlloc(sizeof(KENV));
+
+	e->c = c;
+	e->next = env;
+	return e;
+}
+
+// lookup
+//
+// Returns the value of index i in env
+
+static KCLOS *lookup(KENV *env, int i) {
+	while(i--)
+		env = env->next;
+	return env->c;
+}
+
+// newThunk
+//
+// Returns a closure of code in env. Closed terms do not keep the environment,
+// abstractions are values already.
+
+static KCLOS *newThunk(DBTERM code, KENV *env) {
+	KCLOS *c = arenaAlloc(sizeof(KCLOS));
+
+	c->code = code;
+	c->env = DB_LOOSE(code) ? env : NULL;
+	c->evaluated = DB_TYPE(code) == DB_ABSTR;
+	return c;
+}
+
+// newNeutral
+//
+// Returns a neutral value with the head of n and arguments args
+
+static KCLOS *newNeutral(KCLOS *n, KENV *args) {
+	KCLOS *c = arenaAlloc(sizeof(KCLOS));
+
+	c->code = DB_NULL;
+	c->env = args;
+	c->name = n ? n->name : NULL;
+	c->level = n ? n->level : -1;
+	c->evaluated = 1;
+	return c;
+}
+
+// newHead
+//
+// Returns the head variable of neutral value c, read back at the given depth
+
+static DBTERM newHead(KCLOS *c, int depth) {
+	DBTERM t;
+
+	if(c->level >= 0)
+		return dbNewVar(depth - 1 - c->level);
+
+	t = dbNew(DB_FREE);
+	DB_SETNAME(t, c->name);
+	return t;
+}
+
+// force
+//
+// Continues with the evaluation of closure c. A thunk is evaluated under an
+// update frame, so that its value is stored when found.
+
+static void force(KSTATE *st, KCLOS *c) {
+	if(!c->code) {
+		st->val = c;
+		st->mode = KM_VALUE;
+		return;
+	}
+
+	if(!c->evaluated)
+		push(st, KF_UPD)->c = c;
+
+	st->code = c->code;
+	st->env = c->env;
+	st->mode = KM_EVAL;
+}
+
+// krivineStep
+//
+// Runs the machine until a beta-reduction is performed (returns 1) or the
+// normal form is found (returns 0). Returns -1 if an undeclared alias is met.
+
+static int krivineStep(void *state) {
+	KSTATE *st = state;
+	KFRAME *f;
+	KCLOS *c;
+	KENV *l, *e;
+	DBTERM t, body;
+
+	for(;;) switch(st->mode) {
+	 case KM_EVAL:
+		t = st->code;
+
+		switch(DB_TYPE(t)) {
+		 case DB_APPL:
+			// variables are looked up now, so that the argument is shared
+			// with the value in the environment instead of wrapping it
+			body = DB_R(t);
+			push(st, KF_ARG)->c = DB_TYPE(body) == DB_VAR
+				? lookup(st->env, DB_INDEX(body))
+				: newThunk(body, st->env);
+			st->code = DB_L(t);
+			break;
+
+		 case DB_VAR:
+			force(st, lookup(st->env, DB_INDEX(t)));
+			break;
+
+		 case DB_FREE:
+			c = newNeutral(NULL, NULL);
+			c->name = DB_NAME(t);
+			st->val = c;
+			st->mode = KM_VALUE;
+			break;
+
+		 case DB_ALIAS:
+			if(!(st->code = dbFromDecl(DB_NAME(t)))) {
+				printf("Error: Alias %s is not declared.\n", DB_NAME(t));
+				return -1;
+			}
+			st->env = NULL;
+			break;
+
+		 case DB_ABSTR:
+			// the thunks waiting for this value are updated
+			for(; st->sp && (f = &stack[st->sp - 1])->kind == KF_UPD; st->sp--) {
+				f->c->code = t;
+				f->c->env = st->env;
+				f->c->evaluated = 1;
+			}
+
+			// beta-reduction
+			if(st->sp && f->kind == KF_ARG) {
+				st->env = newEnv(f->c, st->env);
+				st->code = DB_R(t);
+				st->sp--;
+				return 1;
+			}
+
+			// weak head normal form, the body is read back with the variable
+			// bound to a neutral value
+			f = push(st, KF_LAM);
+			f->t = t;
+			f->n = ++st->depth;
+
+			c = newNeutral(NULL, NULL);
+			c->level = st->depth - 1;
+			st->env = newEnv(c, st->env);
+			st->code = DB_R(t);
+			break;
+
+		 default:
+			assert(0);
+			return -1;
+		}
+		break;
+
+	 case KM_VALUE:
+		c = st->val;
+		f = st->sp ? &stack[st->sp - 1] : NULL;
+
+		if(f && f->kind == KF_UPD) {
+			*f->c = *c;
+			st->sp--;
+
+		} else if(f && f->kind == KF_ARG) {
+			st->val = newNeutral(c, newEnv(f->c, c->env));
+			st->sp--;
+
+		} else {
+			// read back the arguments, first one first
+			for(l = NULL, e = c->env; e; e = e->next)
+				l = newEnv(e->c, l);
+			st->res = newHead(c, st->depth);
+
+			if(!l)
+				st->mode = KM_TERM;
+			else {
+				f = push(st, KF_APP);
+				f->t = st->res;
+				f->l = l->next;
+				f->n = st->depth;
+				force(st, l->c);
+			}
+		}
+		break;
+
+	 case KM_TERM:
+		if(!st->sp) {
+			st->mode = KM_DONE;
+			return 0;
+		}
+
+		f = &stack[st->sp - 1];
+		body = st->res;
+
+		if(f->kind == KF_LAM) {
+			// eta-reduction, \.M 0 -> M  if 0 not free in M
+			if(DB_TYPE(body) == DB_APPL &&
+				DB_TYPE(DB_R(body)) == DB_VAR &&
+				DB_INDEX(DB_R(body)) == 0 &&
+				!dbIsFree(DB_L(body), 0)) {
+
+				st->res = DB_L(body);
+				dbShift(st->res, -1, 0);
+				dbFreeNode(DB_R(body));
+				dbFreeNode(body);
+			} else
+				st->res = dbNewAbstr(DB_NAME(f->t), body);
+
+			st->depth = f->n - 1;
+			st->sp--;
+
+		} else {
+			assert(f->kind == KF_APP);
+			t = dbNewAppl(f->t, body);
+			st->depth = f->n;
+
+			if(!f->l) {
+				st->res = t;
+				st->sp--;
+			} else {
+				f->t = t;
+				c = f->l->c;
+				f->l = f->l->next;
+				force(st, c);
+			}
+		}
+		break;
+
+	 case KM_DONE:
+		return 0;
+	}
+}
+
+// unloadClos, unloadCode, unloadArgs
+//
+// Return the term represented by closure c, by code in env or by neutral value c
+// applied to args, placed under depth abstractions (k of which are inside code).
+// Used to display the state of the machine, thunks are shown as they currently
+// are.
+
+static DBTERM unloadCode(DBTERM code, KENV *env, int depth, int k);
+static DBTERM unloadClos(KCLOS *c, int depth);
+
+static DBTERM unloadArgs(KCLOS *c, KENV *args, int depth) {
+	DBTERM l, r;
+
+	// the arguments are kept last first
+	if(!args)
+		return newHead(c, depth);
+
+	l = unloadArgs(c, args->next, depth);
+	r = unloadClos(args->c, depth);
+	return dbNewAppl(l, r);
+}
+
+static DBTERM unloadClos(KCLOS *c, int depth) {
+	return c->code
+		? unloadCode(c->code, c->env, depth, 0)
+		: unloadArgs(c, c->env, depth);
+}
+
+static DBTERM unloadCode(DBTERM code, KENV *env, int depth, int k) {
+	DBTERM t, l, r;
+
+	switch(DB_TYPE(code)) {
+	 case DB_VAR:
+		return DB_INDEX(code) < k
+			? dbNewVar(DB_INDEX(code))
+			: unloadClos(lookup(env, DB_INDEX(code) - k), depth + k);
+
+	 case DB_ABSTR:
+		r = unloadCode(DB_R(code), env, depth, k + 1);
+		return dbNewAbstr(DB_NAME(code), r);
+
+	 case DB_APPL:
+		l = unloadCode(DB_L(code), env, depth, k);
+		r = unloadCode(DB_R(code), env, depth, k);
+		return dbNewAppl(l, r);
+
+	 default:
+		t = dbNew(DB_TYPE(code));
+		DB_SETNAME(t, DB_NAME(code));
+		return t;
+	}
+}
+
+
+// ------- Engine interface --------
+
+static void *krivineStart(TERM *t) {
+	KSTATE *st = arenaAlloc(sizeof(KSTATE));
+
+	st->mode = KM_EVAL;
+	st->code = dbFromTerm(t);
+	st->env = NULL;
+	st->depth = 0;
+	st->sp = 0;
+	st->shown = NULL;
+	return st;
+}
+
+// krivineTerm
+//
+// Returns the normal form, or while the machine runs the term it represents:
+// the term in the head with the frames of the stack (from the top) wrapped
+// around it.
+
+static TERM *krivineTerm(void *state) {
+	KSTATE *st = state;
+	KFRAME *f;
+	DBTERM t, r;
+	KENV *l;
+	int i, depth = st->depth;
+
+	switch(st->mode) {
+	 case KM_EVAL:
+		t = unloadCode(st->code, st->env, depth, 0);
+		break;
+	 case KM_VALUE:
+		t = unloadClos(st->val, depth);
+		break;
+	 default:
+		t = st->res;
+	}
+
+	for(i = st->sp - 1; i >= 0; i--) {
+		f = &stack[i];
+
+		switch(f->kind) {
+		 case KF_ARG:
+			r = unloadClos(f->c, depth);
+			t = dbNewAppl(t, r);
+			break;
+
+		 case KF_UPD:
+			break;
+
+		 case KF_LAM:
+			t = dbNewAbstr(DB_NAME(f->t), t);
+			depth = f->n - 1;
+			break;
+
+		 case KF_APP:
+			t = dbNewAppl(f->t, t);
+			for(l = f->l; l; l = l->next) {
+				r = unloadClos(l->c, depth);
+				t = dbNewAppl(t, r);
+			}
+			break;
+		}
+	}
+
+	termFree(st->shown);
+	st->shown = dbToTerm(t);
+	return st->shown;
+}
+
+ENGINE krivineEngine = { "krivine", krivineStart, krivineStep, krivineTerm, NULL };
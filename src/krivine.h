@@ -0,0 +1,57 @@
+// vim:noet:ts=3
+
+/* Declarations for krivine.c
+
+	Copyright (C) 2004-8 Kostas Chatzikokolakis
+	This file is part of LCI
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details. */
+
+#ifndef KRIVINE_H
+#define KRIVINE_H
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "dbterm.h"
+#include "engine.h"
+
+
+// A closure is a term (in de Bruijn form, never modified) together with the
+// values of its loose variables. The environment is a list, the value of index
+// i is its i-th element. Closures of arguments are thunks, they are updated
+// with their weak head normal form the first time it is computed, so they are
+// evaluated at most once.
+//
+// A closure with no code is a neutral value, a variable applied to some
+// arguments (kept in env, the last one first). The variable is either free
+// (name) or bound by the level-th abstraction (counting from the root) of the
+// normal form being read back.
+
+typedef struct tag_kenv {
+	struct tag_kclos *c;
+	struct tag_kenv *next;
+} KENV;
+
+typedef struct tag_kclos {
+	DBTERM code;
+	KENV *env;
+	char *name;
+	int level;
+	char evaluated;						// code is in weak head normal form
+} KCLOS;
+
+
+extern ENGINE krivineEngine;
+
+
+#endif
@@ -29,16 +29,50 @@
 #include "grammar.h"
 #include "parser.h"
 #include "run.h"
+#include "engine.h"
+#include "native.h"
 
 #define MAX_HISTORY_ENTRIES 100
 
 
-int main() {
+// Command line:
+//   lci [--native lib] [file ...]			consults the files and reads commands,
+//													using the compiled code of lib
+//   lci --compile file ... -o lib			compiles all declarations to lib
+
+int main(int argc, char *argv[]) {
 	TERM *t;
 	char *home = getenv("HOME"),
 		 *lcirc = ".lcirc",
 		 *lci_history = "/.lci_history",
-		 *path;
+		 *path,
+		 *native = NULL,
+		 *out = NULL,
+		 **files;
+	int i, compile = 0, fileNo = 0;
+
+	// parse the command line
+	if(!(files = malloc(argc * sizeof(char*)))) {
+		fprintf(stderr, "Error: out of memory.\n");
+		return 1;
+	}
+	for(i = 1; i < argc; i++) {
+		if(strcmp(argv[i], "--compile") == 0)
+			compile = 1;
+		else if(strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+			out = argv[++i];
+		else if(strcmp(argv[i], "--native") == 0 && i + 1 < argc)
+			native = argv[++i];
+		else if(argv[i][0] != '-')
+			files[fileNo++] = argv[i];
+		else
+			break;
+	}
+	if(i < argc || (compile && (!out || native)) || (!compile && out)) {
+		fprintf(stderr, "Usage: lci [--native lib] [file ...]\n");
+		fprintf(stderr, "       lci --compile file ... -o lib\n");
+		return 1;
+	}
 
 #ifdef USE_READLINE
 	char *buffer = NULL;
@@ -60,10 +94,12 @@ int main() {
 	char *s;
 #endif
 
-	printf("lci - A lambda calculus interpreter\n");
-	printf("Copyright (C) 2004-8 Kostas Chatzikokolakis\n");
-	printf("This is FREE SOFTWARE and comes with ABSOLUTELY NO WARRANTY\n\n");
-	printf("Type a term, Help for info or Quit to exit.\n");
+	if(!compile) {
+		printf("lci - A lambda calculus interpreter\n");
+		printf("Copyright (C) 2004-8 Kostas Chatzikokolakis\n");
+		printf("This is FREE SOFTWARE and comes with ABSOLUTELY NO WARRANTY\n\n");
+		printf("Type a term, Help for info or Quit to exit.\n");
+	}
 
 	// consult .lcirc files in various places
 	int found = 0;
@@ -97,6 +133,20 @@ int main() {
 	if(!found)
 	   fprintf(stderr, "warning: no .lcirc file was found\n");
 
+	// files given in the command line
+	for(i = 0; i < fileNo; i++)
+		if(consultFile(files[i]) == -1)
+			printf("Error: cannot open %s\n", files[i]);
+	free(files);
+
+	// compile the declarations, or use compiled ones with the nbe engine
+	// (declarations that are not compiled are interpreted)
+	if(compile)
+		return nativeCompile(out) == 0 ? 0 : 1;
+
+	if(native && nativeLoad(native) == 0)
+		setOption(OPT_ENGINE, getEngine("nbe"));
+
 	// read and execute commands
 	while(!feof(stdin)) {
 		// read command
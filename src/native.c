@@ -0,0 +1,691 @@
+// vim:noet:ts=3
+
+/* Compilation of declarations to native code
+
+	Copyright (C) 2004-8 Kostas Chatzikokolakis
+	This file is part of LCI
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details. */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#if HAVE_UNISTD_H
+#include <unistd.h>
+#include <sys/wait.h>
+#endif
+#if HAVE_DLOPEN && HAVE_DLFCN_H
+#include <dlfcn.h>
+#endif
+
+#include "native.h"
+#include "nbe.h"
+#include "dbterm.h"
+#include "symbol.h"
+
+
+// nativeCompile translates all declarations to C, with the values of the nbe
+// engine. Each compiled unit is a C function:
+// - the body of an abstraction, a function of its argument x and of the values
+//   of the abstraction's loose variables, captured when the closure is created
+// - an argument that is an application, computing the value of its thunk
+// - the term of a declaration, computing the value of the alias
+// Bound variables are read directly from x and the captured array, and
+// arguments become closures and thunks of compiled code, so nothing is
+// interpreted. The file is then built as a shared library by the C compiler.
+//
+// nativeLoad opens such a library when lci starts. The nbe engine uses its code
+// for the value of a declaration (see aliasValue in nbe.c), if the declaration
+// still has the term it was compiled from (the library keeps a hash of each
+// term). Declarations added or changed later are interpreted.
+
+#ifndef NATIVE_CC
+#define NATIVE_CC		"cc"
+#endif
+#define NATIVE_CFLAGS	"-O2 -shared -fPIC"
+
+#define CAP_BLOCK		8					// captured values per block (see nrEnv in nbe.c)
+#define HASH_BASIS	2166136261UL		// FNV-1a
+#define HASH_PRIME	16777619UL
+
+typedef struct {
+	char *s;
+	size_t len, size;
+} NBUF;
+
+// a unit being compiled: its code, the outer index of each captured value and
+// whether it is the body of an abstraction (so index 0 is x)
+typedef struct {
+	NBUF b;
+	int *cap, capNo;
+	int abstr;
+	int temps;
+} NUNIT;
+
+typedef struct tag_nlib {
+	char **names;
+	NATIVE_ENTRY *entries;
+	struct tag_nlib *next;
+} NLIB;
+
+static NLIB *libs = NULL;
+static NATIVE_ENTRY noEntry;				// DECL.native of declarations without code
+
+static char **names = NULL;				// names used by the generated code
+static int nameNo, nameSize, unitNo;
+
+static const char *prelude =
+	"/* Generated by lci --compile, load with lci --native */\n\n"
+	"typedef void *(*NATIVE_CODE)(void **cap, void *x);\n\n"
+	"typedef struct {\n"
+	"\tvoid **(*env)(int n);\n"
+	"\tvoid *(*clos)(NATIVE_CODE code, char *name, void **cap);\n"
+	"\tvoid *(*thunk)(NATIVE_CODE code, void **cap);\n"
+	"\tvoid *(*alias)(char *id);\n"
+	"\tvoid *(*aliasArg)(char *id);\n"
+	"\tvoid *(*freeVar)(char *name);\n"
+	"\tvoid *(*force)(void *v);\n"
+	"\tvoid *(*apply)(void *f, void *x);\n"
+	"\tvoid *(*tail)(void *f, void *x);\n"
+	"} NATIVE_RT;\n\n"
+	"typedef struct {\n"
+	"\tint name;\n"
+	"\tunsigned long hash;\n"
+	"\tNATIVE_CODE code;\n"
+	"} NATIVE_ENTRY;\n\n"
+	"extern char *lciNativeNames[];\n"
+	"#define NAME(i)\tlciNativeNames[i]\n\n"
+	"static const NATIVE_RT *rt;\n\n";
+
+
+static int genEval(FILE *f, NUNIT *u, DBTERM t, int tail);
+
+// bufPrintf
+//
+// Appends to b, like printf
+
+static void bufPrintf(NBUF *b, const char *fmt, ...) {
+	va_list ap;
+	int n;
+
+	if(!b->s && !(b->s = malloc(b->size = 256))) {
+		fprintf(stderr, "Error: out of memory.\n");
+		exit(1);
+	}
+
+	for(;;) {
+		va_start(ap, fmt);
+		n = vsnprintf(b->s + b->len, b->size - b->len, fmt, ap);
+		va_end(ap);
+
+		if(n >= 0 && b->len + n < b->size)
+			break;
+
+		b->size = 2 * b->size + n;
+		if(!(b->s = realloc(b->s, b->size))) {
+			fprintf(stderr, "Error: out of memory.\n");
+			exit(1);
+		}
+	}
+	b->len += n;
+}
+
+// nameIndex
+//
+// Returns the index of (interned) name in the names of the generated code, -1
+// for NULL
+
+static int nameIndex(char *name) {
+	int i;
+
+	if(!name)
+		return -1;
+
+	for(i = 0; i < nameNo; i++)
+		if(names[i] == name)
+			return i;
+
+	if(nameNo == nameSize &&
+		!(names = realloc(names, (nameSize = nameSize ? 2 * nameSize : 64) * sizeof(char*)))) {
+		fprintf(stderr, "Error: out of memory.\n");
+		exit(1);
+	}
+	names[nameNo] = name;
+	return nameNo++;
+}
+
+// termHash
+//
+// Returns h updated with the hash of t (strategy marks are not included, the
+// nbe engine does not use them)
+
+static unsigned long hashStr(unsigned long h, char *s) {
+	if(s)
+		while(*s)
+			h = ((h ^ (unsigned char)*s++) * HASH_PRIME) & 0xFFFFFFFFUL;
+	return h;
+}
+
+static unsigned long termHash(DBTERM t, unsigned long h) {
+	for(;;) {
+		h = ((h ^ DB_TYPE(t)) * HASH_PRIME) & 0xFFFFFFFFUL;
+
+		switch(DB_TYPE(t)) {
+		 case DB_VAR:
+			return ((h ^ DB_INDEX(t)) * HASH_PRIME) & 0xFFFFFFFFUL;
+
+		 case DB_FREE:
+		 case DB_ALIAS:
+			return hashStr(h, DB_NAME(t));
+
+		 case DB_ABSTR:
+			h = hashStr(h, DB_NAME(t));
+			t = DB_R(t);
+			break;
+
+		 case DB_APPL:
+			h = termHash(DB_L(t), h);
+			t = DB_R(t);
+			break;
+		}
+	}
+}
+
+// looseVars
+//
+// Stores in vars the indices (relative to the root of t) that point outside t,
+// in increasing order, and returns their number. vars must be freed by the caller.
+
+static int looseMax(DBTERM t, int depth) {
+	int l, r;
+
+	if(DB_LOOSE(t) <= depth)
+		return 0;
+
+	switch(DB_TYPE(t)) {
+	 case DB_VAR:
+		return DB_INDEX(t) - depth + 1;
+	 case DB_ABSTR:
+		return looseMax(DB_R(t), depth + 1);
+	 case DB_APPL:
+		l = looseMax(DB_L(t), depth);
+		r = looseMax(DB_R(t), depth);
+		return l > r ? l : r;
+	 default:
+		return 0;
+	}
+}
+
+static void looseMark(DBTERM t, int depth, char *mark) {
+	if(DB_LOOSE(t) <= depth)
+		return;
+
+	switch(DB_TYPE(t)) {
+	 case DB_VAR:
+		mark[DB_INDEX(t) - depth] = 1;
+		break;
+	 case DB_ABSTR:
+		looseMark(DB_R(t), depth + 1, mark);
+		break;
+	 case DB_APPL:
+		looseMark(DB_L(t), depth, mark);
+		looseMark(DB_R(t), depth, mark);
+		break;
+	 default:
+		break;
+	}
+}
+
+static int looseVars(DBTERM t, int **vars) {
+	int size = looseMax(t, 0), n = 0, i;
+	char *mark = calloc(size + 1, 1);
+
+	*vars = malloc((size + 1) * sizeof(int));
+	if(!mark || !*vars) {
+		fprintf(stderr, "Error: out of memory.\n");
+		exit(1);
+	}
+
+	looseMark(t, 0, mark);
+	for(i = 0; i < size; i++)
+		if(mark[i])
+			(*vars)[n++] = i;
+
+	free(mark);
+	return n;
+}
+
+// putCap
+//
+// Appends the place of captured value k (of n) in array arr. At most CAP_BLOCK
+// values fit in a block, if there are more the last slot points to the next block.
+// (A single captured value is passed in place of the array, see genArg.)
+
+static void putCap(NBUF *b, char *arr, int k, int n) {
+	int links = 0, i;
+
+	for(; n > CAP_BLOCK && k >= CAP_BLOCK - 1; n -= CAP_BLOCK - 1, k -= CAP_BLOCK - 1)
+		links++;
+
+	for(i = 0; i < links; i++)
+		bufPrintf(b, "((void**)");
+	bufPrintf(b, "%s", arr);
+	for(i = 0; i < links; i++)
+		bufPrintf(b, "[%d])", CAP_BLOCK - 1);
+	bufPrintf(b, "[%d]", k);
+}
+
+// putVar
+//
+// Appends the value of the variable with index i in unit u
+
+static void putVar(NUNIT *u, int i) {
+	int k;
+
+	if(u->abstr && i-- == 0) {
+		bufPrintf(&u->b, "x");
+		return;
+	}
+
+	for(k = 0; u->cap[k] != i; k++)
+		;
+	if(u->capNo == 1)
+		bufPrintf(&u->b, "(void*)cap");
+	else
+		putCap(&u->b, "cap", k, u->capNo);
+}
+
+// compileUnit
+//
+// Writes to f the function computing t (the body of an abstraction if abstr is
+// set) with the given captured values, after the functions it uses. Returns the
+// number of the function.
+
+static int compileUnit(FILE *f, DBTERM t, int abstr, int *cap, int capNo) {
+	NUNIT u;
+
+	u.b.s = NULL;
+	u.b.len = u.b.size = 0;
+	u.cap = cap;
+	u.capNo = capNo;
+	u.abstr = abstr;
+	u.temps = 0;
+
+	genEval(f, &u, t, 1);
+
+	fprintf(f, "static void *u%d(void **cap, void *x) {\n%s}\n\n", unitNo, u.b.s);
+	free(u.b.s);
+	return unitNo++;
+}
+
+// genArg
+//
+// Generates the code creating the value of argument t (without evaluating it),
+// returns the temporary that holds it
+
+static int genArg(FILE *f, NUNIT *u, DBTERM t) {
+	int v = u->temps++, e = -1, unit, *cap, capNo, k;
+	char arr[16];
+
+	switch(DB_TYPE(t)) {
+	 case DB_VAR:
+		bufPrintf(&u->b, "\tvoid *v%d = ", v);
+		putVar(u, DB_INDEX(t));
+		bufPrintf(&u->b, ";\n");
+		return v;
+
+	 case DB_FREE:
+		bufPrintf(&u->b, "\tvoid *v%d = rt->freeVar(NAME(%d));\n", v, nameIndex(DB_NAME(t)));
+		return v;
+
+	 case DB_ALIAS:
+		bufPrintf(&u->b, "\tvoid *v%d = rt->aliasArg(NAME(%d));\n", v, nameIndex(DB_NAME(t)));
+		return v;
+
+	 default:
+		break;
+	}
+
+	// abstractions and applications get their own function and capture their
+	// loose variables (a single one is passed instead of the array)
+	capNo = looseVars(t, &cap);
+	if(DB_TYPE(t) == DB_ABSTR)
+		unit = compileUnit(f, DB_R(t), 1, cap, capNo);
+	else
+		unit = compileUnit(f, t, 0, cap, capNo);
+
+	if(capNo > 1) {
+		e = u->temps++;
+		bufPrintf(&u->b, "\tvoid **e%d = rt->env(%d);\n", e, capNo);
+		sprintf(arr, "e%d", e);
+		for(k = 0; k < capNo; k++) {
+			bufPrintf(&u->b, "\t");
+			putCap(&u->b, arr, k, capNo);
+			bufPrintf(&u->b, " = ");
+			putVar(u, cap[k]);
+			bufPrintf(&u->b, ";\n");
+		}
+	}
+
+	if(DB_TYPE(t) == DB_ABSTR) {
+		k = nameIndex(DB_NAME(t));
+		bufPrintf(&u->b, "\tvoid *v%d = rt->clos(u%d, ", v, unit);
+		if(k >= 0)
+			bufPrintf(&u->b, "NAME(%d), ", k);
+		else
+			bufPrintf(&u->b, "0, ");
+	} else
+		bufPrintf(&u->b, "\tvoid *v%d = rt->thunk(u%d, ", v, unit);
+
+	if(capNo == 1) {
+		bufPrintf(&u->b, "(void**)");
+		putVar(u, cap[0]);
+		bufPrintf(&u->b, ");\n");
+	} else if(e >= 0)
+		bufPrintf(&u->b, "e%d);\n", e);
+	else
+		bufPrintf(&u->b, "0);\n");
+
+	free(cap);
+	return v;
+}
+
+// genEval
+//
+// Generates the code computing the value of t. If tail is set the value is
+// returned (a call in the body of an abstraction is left to the caller, see
+// nrTail in nbe.c), otherwise the temporary that holds it is returned.
+
+static int genEval(FILE *f, NUNIT *u, DBTERM t, int tail) {
+	DBTERM h;
+	DBTERM *args;
+	int n = 0, i, v, a;
+
+	// collect the arguments of the spine
+	for(h = t; DB_TYPE(h) == DB_APPL; h = DB_L(h))
+		n++;
+	if(!(args = malloc((n + 1) * sizeof(DBTERM)))) {
+		fprintf(stderr, "Error: out of memory.\n");
+		exit(1);
+	}
+	for(i = n, h = t; DB_TYPE(h) == DB_APPL; h = DB_L(h))
+		args[--i] = DB_R(h);
+
+	// the head
+	switch(DB_TYPE(h)) {
+	 case DB_VAR:
+		v = u->temps++;
+		bufPrintf(&u->b, "\tvoid *v%d = rt->force(", v);
+		putVar(u, DB_INDEX(h));
+		bufPrintf(&u->b, ");\n\tif(!v%d) return 0;\n", v);
+		break;
+
+	 case DB_ALIAS:
+		v = u->temps++;
+		bufPrintf(&u->b, "\tvoid *v%d = rt->alias(NAME(%d));\n\tif(!v%d) return 0;\n",
+			v, nameIndex(DB_NAME(h)), v);
+		break;
+
+	 default:
+		v = genArg(f, u, h);
+		break;
+	}
+
+	// the applications
+	for(i = 0; i < n; i++) {
+		a = genArg(f, u, args[i]);
+
+		if(tail && i == n - 1) {
+			bufPrintf(&u->b, "\treturn rt->%s(v%d, v%d);\n", u->abstr ? "tail" : "apply", v, a);
+			free(args);
+			return -1;
+		}
+		bufPrintf(&u->b, "\tv%d = rt->apply(v%d, v%d);\n\tif(!v%d) return 0;\n", v, v, a, v);
+	}
+	free(args);
+
+	if(tail)
+		bufPrintf(&u->b, "\treturn v%d;\n", v);
+	return v;
+}
+
+// putString
+//
+// Writes s to f as a C string literal
+
+static void putString(FILE *f, char *s) {
+	fputc('"', f);
+	for(; *s; s++)
+		if(*s == '"' || *s == '\\')
+			fprintf(f, "\\%c", *s);
+		else if(*s < ' ' || *s > '~')
+			fprintf(f, "\\%03o", (unsigned char)*s);
+		else
+			fputc(*s, f);
+	fputc('"', f);
+}
+
+// runCompiler
+//
+// Runs the C compiler cc (a command, possibly followed by arguments separated
+// by spaces) to build the library out from src. The compiler is started
+// directly, not through a shell, so the file names are passed as they are.
+// Returns the exit status of the compiler, -1 if it could not be run.
+
+static int runCompiler(char *cc, char *out, char *src) {
+#if HAVE_UNISTD_H
+	char *line, **argv, *w;
+	int argc = 0, status = -1;
+	pid_t pid;
+
+	// a word takes at least two characters of line
+	if(!(line = malloc(strlen(cc) + strlen(NATIVE_CFLAGS) + 2)) ||
+		!(argv = malloc((strlen(cc) + strlen(NATIVE_CFLAGS) + 10) / 2 * sizeof(char*)))) {
+		fprintf(stderr, "Error: out of memory.\n");
+		exit(1);
+	}
+	sprintf(line, "%s %s", cc, NATIVE_CFLAGS);
+
+	for(w = strtok(line, " \t"); w; w = strtok(NULL, " \t"))
+		argv[argc++] = w;
+	argv[argc++] = "-o";
+	argv[argc++] = out;
+	argv[argc++] = src;
+	argv[argc] = NULL;
+
+	fflush(stdout);
+	if((pid = fork()) == 0) {
+		execvp(argv[0], argv);
+		fprintf(stderr, "Error: cannot run %s\n", argv[0]);
+		_exit(127);
+	}
+	if(pid > 0 && waitpid(pid, &status, 0) == pid)
+		status = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+	else
+		status = -1;
+
+	free(argv);
+	free(line);
+	return status;
+#else
+	printf("Error: cannot run the C compiler on this system.\n");
+	return -1;
+#endif
+}
+
+// nativeCompile
+//
+// Compiles all declarations to the shared library out. Returns 0 on success,
+// -1 on error.
+
+int nativeCompile(char *out) {
+	char *lib, *src, *cc = getenv("CC");
+	FILE *f;
+	DECL *d;
+	DBTERM t;
+	int *units, n = 0, i, res;
+
+	if(!cc || !*cc)
+		cc = NATIVE_CC;
+
+	// the file names must not look like options of the compiler
+	if(!(lib = malloc(strlen(out) + 3)) || !(src = malloc(strlen(out) + 5))) {
+		fprintf(stderr, "Error: out of memory.\n");
+		exit(1);
+	}
+	sprintf(lib, "%s%s", *out == '-' ? "./" : "", out);
+	sprintf(src, "%s.c", lib);
+
+	if(!(f = fopen(src, "w"))) {
+		printf("Error: cannot open %s\n", src);
+		free(lib);
+		free(src);
+		return -1;
+	}
+	fputs(prelude, f);
+
+	for(d = declList; d; d = d->next)
+		n++;
+	if(!(units = malloc((n + 1) * sizeof(int)))) {
+		fprintf(stderr, "Error: out of memory.\n");
+		exit(1);
+	}
+
+	nameNo = unitNo = 0;
+	for(i = 0, d = declList; d; d = d->next, i++) {
+		t = dbFromDecl(d->id);
+		units[i] = compileUnit(f, t, 0, NULL, 0);
+	}
+
+	// the tables read by nativeLoad
+	fprintf(f, "char *lciNativeNames[] = {\n");
+	for(i = 0; i < nameNo; i++) {
+		fprintf(f, "\t");
+		putString(f, names[i]);
+		fprintf(f, ",\n");
+	}
+	fprintf(f, "\t0\n};\n\n");
+
+	fprintf(f, "NATIVE_ENTRY lciNativeEntries[] = {\n");
+	for(i = 0, d = declList; d; d = d->next, i++)
+		fprintf(f, "\t{ %d, %luUL, u%d },\n",
+			nameIndex(d->id), termHash(dbFromDecl(d->id), HASH_BASIS), units[i]);
+	fprintf(f, "\t{ -1, 0, 0 }\n};\n\n");
+
+	fprintf(f, "int lciNativeVersion = %d;\n\n", NATIVE_VERSION);
+	fprintf(f, "void lciNativeInit(const NATIVE_RT *r) {\n\trt = r;\n}\n");
+	fclose(f);
+
+	free(units);
+	free(names);
+	names = NULL;
+	nameSize = 0;
+
+	// build the library
+	if((res = runCompiler(cc, lib, src)) == 0)
+		remove(src);
+	else
+		printf("Error: %s failed, the generated code is kept in %s\n", cc, src);
+
+	free(lib);
+	free(src);
+	return res == 0 ? 0 : -1;
+}
+
+// nativeLoad
+//
+// Opens a library built by nativeCompile. Returns 0 on success, -1 on error.
+
+int nativeLoad(char *file) {
+#if HAVE_DLOPEN && HAVE_DLFCN_H
+	void *h;
+	void (*init)(const NATIVE_RT *r);
+	char *path, **n;
+	int *version;
+	NLIB *lib;
+
+	// dlopen searches the library path for names without a slash
+	if(!(path = malloc(strlen(file) + 3))) {
+		fprintf(stderr, "Error: out of memory.\n");
+		exit(1);
+	}
+	sprintf(path, "%s%s", strchr(file, '/') ? "" : "./", file);
+	h = dlopen(path, RTLD_NOW);
+	free(path);
+
+	if(!h) {
+		printf("Error: %s\n", dlerror());
+		return -1;
+	}
+
+	if(!(lib = malloc(sizeof(NLIB)))) {
+		fprintf(stderr, "Error: out of memory.\n");
+		exit(1);
+	}
+	version = dlsym(h, "lciNativeVersion");
+	lib->names = dlsym(h, "lciNativeNames");
+	lib->entries = dlsym(h, "lciNativeEntries");
+	*(void**)&init = dlsym(h, "lciNativeInit");
+
+	if(!version || *version != NATIVE_VERSION || !lib->names || !lib->entries || !init) {
+		printf("Error: %s was not compiled by this version of lci.\n", file);
+		free(lib);
+		dlclose(h);
+		return -1;
+	}
+
+	// the generated code uses the names of values, which must be interned
+	for(n = lib->names; *n; n++)
+		*n = intern(*n);
+	init(&nbeNative);
+
+	lib->next = libs;
+	libs = lib;
+	return 0;
+#else
+	printf("Error: native code is not supported on this system.\n");
+	return -1;
+#endif
+}
+
+// nativeCode
+//
+// Returns the compiled code of declaration d, or NULL if no library has code
+// for its current term. The result is cached in the DECL until declFlush.
+
+NATIVE_CODE nativeCode(DECL *d) {
+	NLIB *lib;
+	NATIVE_ENTRY *e;
+	unsigned long hash;
+
+	if(!libs)
+		return NULL;
+
+	if(!d->native) {
+		d->native = &noEntry;
+		hash = termHash(dbFromDecl(d->id), HASH_BASIS);
+
+		for(lib = libs; lib && d->native == &noEntry; lib = lib->next)
+			for(e = lib->entries; e->code; e++)
+				if(lib->names[e->name] == d->id) {
+					if(e->hash == hash)
+						d->native = e;
+					break;
+				}
+	}
+
+	return ((NATIVE_ENTRY*)d->native)->code;
+}
@@ -0,0 +1,65 @@
+// vim:noet:ts=3
+
+/* Declarations for native.c
+
+	Copyright (C) 2004-8 Kostas Chatzikokolakis
+	This file is part of LCI
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details. */
+
+#ifndef NATIVE_H
+#define NATIVE_H
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "decllist.h"
+
+// Interface between lci and a compiled library. The library sees values only
+// as pointers, it creates and applies them through the functions of NATIVE_RT
+// (implemented by the nbe engine). Each compiled function gets the values it
+// captured and, if it is the body of an abstraction, the argument x.
+//
+// The generated code repeats these declarations (see prelude in native.c), so
+// any change here must be made there too and NATIVE_VERSION increased.
+
+#define NATIVE_VERSION	1
+
+typedef void *(*NATIVE_CODE)(void **cap, void *x);
+
+typedef struct {
+	void **(*env)(int n);									// room for n captured values
+	void *(*clos)(NATIVE_CODE code, char *name, void **cap);
+	void *(*thunk)(NATIVE_CODE code, void **cap);
+	void *(*alias)(char *id);								// value of a declaration
+	void *(*aliasArg)(char *id);							// same, not yet evaluated
+	void *(*freeVar)(char *name);
+	void *(*force)(void *v);
+	void *(*apply)(void *f, void *x);
+	void *(*tail)(void *f, void *x);						// apply, as the last call of an abstraction
+} NATIVE_RT;
+
+// compiled declaration: index of its id in the library's names, hash of its
+// term when it was compiled and the function computing its value
+typedef struct {
+	int name;
+	unsigned long hash;
+	NATIVE_CODE code;
+} NATIVE_ENTRY;
+
+
+int nativeCompile(char *out);
+int nativeLoad(char *file);
+NATIVE_CODE nativeCode(DECL *d);
+
+
+#endif
@@ -0,0 +1,558 @@
+// vim:noet:ts=3
+
+/* Normalization by evaluation
+
+	Copyright (C) 2004-8 Kostas Chatzikokolakis
+	This file is part of LCI
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details. */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include "nbe.h"
+#include "dbterm.h"
+#include "decllist.h"
+#include "termalloc.h"
+#include "run.h"
+
+
+// Terms are evaluated into values: an abstraction becomes a closure (its code
+// with the values of its loose variables) and a variable that cannot be reduced
+// becomes a neutral value, applied to the values of its arguments. The normal
+// form is then quoted back from the value: a closure is applied to a fresh
+// neutral variable and the result is quoted under one more abstraction. Bound
+// variables of values are de Bruijn levels (counted from the root), so quoting
+// needs neither substitution nor renaming.
+//
+// Arguments are thunks, evaluated the first time they are needed and replaced
+// by their value. Declarations are closed, so the value of an alias is the same
+// in the whole query, it is computed once and kept in the DECL.
+//
+// Declarations compiled by nativeCompile are values too: their closures and
+// thunks have native code (and the values it captured) instead of a term and an
+// environment. The compiled code calls back the functions of nbeNative below.
+//
+// Evaluation and quoting are recursive, the nesting is limited to NBE_NEST_MAX
+// so that a deep computation stops with an error instead of overflowing the C
+// stack (the other engines can be used for such terms).
+
+#define NBE_NEST_MAX	20000
+
+enum nval_kind_tag { NV_THUNK, NV_CLOS, NV_NEUTRAL } ATTR_PACKED;
+typedef enum nval_kind_tag NVAL_KIND;
+
+typedef struct tag_nenv {
+	struct tag_nval *v;
+	struct tag_nenv *next;
+} NENV;
+
+// code and env for thunks and closures, head (a free variable name or the
+// level of a bound one) and arguments (in env, last one first) for neutral values.
+// Compiled thunks and closures have native code and cap instead (and the name
+// of the bound variable of closures), a thunk without code is an alias (name).
+typedef struct tag_nval {
+	NVAL_KIND kind;
+	char compiled;							// native and cap are used instead of code and env
+	int level;
+	union {
+		DBTERM code;
+		NATIVE_CODE native;
+	};
+	union {
+		NENV *env;
+		void **cap;
+	};
+	char *name;
+} NVAL;
+
+typedef struct {
+	DBTERM code;							// the query
+	TERM *t;
+	DBTERM res;								// its normal form, once computed
+	TERM *shown;							// last term returned by nbeTerm
+} NSTATE;
+
+static int reductions, nest;
+static int traced;						// trace was on when the step started
+
+static NVAL tailMark;					// returned by compiled code for a call left to nrTail
+static NVAL *tailF, *tailX;
+
+
+static NVAL *eval(DBTERM code, NENV *env);
+static NVAL *aliasValue(char *id);
+static NVAL *apply(NVAL *f, NVAL *x);
+
+// newVal
+//
+// Returns a new value of the given kind
+
+static NVAL *newVal(NVAL_KIND kind, DBTERM code, NENV *env) {
+	NVAL *v = arenaAlloc(sizeof(NVAL));
+
+	v->kind = kind;
+	v->code = code;
+	v->env = env;
+	v->compiled = 0;
+	return v;
+}
+
+// newNeutral
+//
+// Returns the neutral value with head name/level and arguments args
+
+static NVAL *newNeutral(char *name, int level, NENV *args) {
+	NVAL *v = newVal(NV_NEUTRAL, DB_NULL, args);
+
+	v->name = name;
+	v->level = level;
+	return v;
+}
+
+// newEnv
+//
+// Returns the environment env extended with v (which gets index 0)
+
+static NENV *newEnv(NVAL *v, NENV *env) {
+	NENV *e = arenaAlloc(sizeof(NENV));
+
+	e->v = v;
+	e->next = env;
+	return e;
+}
+
+// lookup
+//
+// Returns the value of index i in env
+
+static NVAL *lookup(NENV *env, int i) {
+	while(i--)
+		env = env->next;
+	return env->v;
+}
+
+// stopped
+//
+// Returns 1 if the query must stop (interrupted or out of memory)
+
+static int stopped() {
+	// the normal form is computed in one step, so a SIGINT (which enables
+	// trace) cannot stop the query between steps
+	if(trace && !traced) {
+		printf("Error: interrupted after %d reductions.\n", reductions);
+		return 1;
+	}
+	return memExceeded;
+}
+
+// enter
+//
+// Counts a nested evaluation (the caller decreases nest when it returns),
+// returns 0 if the nesting is too deep.
+
+static int enter() {
+	if(++nest > NBE_NEST_MAX) {
+		printf("Error: evaluation nested too deeply, try another engine.\n");
+		return 0;
+	}
+	return 1;
+}
+
+// force
+//
+// Returns the value of v, a thunk is evaluated and replaced by its value.
+// Returns NULL on error.
+
+static NVAL *force(NVAL *v) {
+	NVAL *r;
+
+	if(v->kind == NV_THUNK) {
+		if(!enter() ||
+			!(r = v->compiled ? v->native(v->cap, NULL)
+					: v->code ? eval(v->code, v->env)
+					: aliasValue(v->name)))
+			return NULL;
+		*v = *r;
+		nest--;
+	}
+	return v;
+}
+
+// aliasValue
+//
+// Returns the value of the declaration with the given id, computed once per query
+
+static NVAL *aliasValue(char *id) {
+	DECL *decl = getDecl(id);
+	NATIVE_CODE native;
+	NVAL *v;
+
+	if(!decl) {
+		printf("Error: Alias %s is not declared.\n", id);
+		return NULL;
+	}
+
+	if(decl->valueQuery != queryNo) {
+		native = nativeCode(decl);
+		if(!enter() || !(v = native ? native(NULL, NULL) : eval(dbFromDecl(id), NULL)))
+			return NULL;
+		nest--;
+
+		decl->value = v;
+		decl->valueQuery = queryNo;
+	}
+	return decl->value;
+}
+
+// argument
+//
+// Returns the value of argument code in env without evaluating it. A variable
+// shares the value it refers to.
+
+static NVAL *argument(DBTERM code, NENV *env) {
+	switch(DB_TYPE(code)) {
+	 case DB_VAR:
+		return lookup(env, DB_INDEX(code));
+
+	 case DB_ABSTR:
+		return newVal(NV_CLOS, code, env);
+
+	 default:
+		return newVal(NV_THUNK, code, DB_LOOSE(code) ? env : NULL);
+	}
+}
+
+// eval
+//
+// Returns the value of code in env, or NULL on error. The body of an applied
+// closure is evaluated in the same loop, only the function of an application
+// and the thunks are evaluated by nested calls.
+
+static NVAL *eval(DBTERM code, NENV *env) {
+	NVAL *f;
+
+	for(;;) {
+		if(stopped())
+			return NULL;
+
+		switch(DB_TYPE(code)) {
+		 case DB_VAR:
+			return force(lookup(env, DB_INDEX(code)));
+
+		 case DB_FREE:
+			return newNeutral(DB_NAME(code), -1, NULL);
+
+		 case DB_ALIAS:
+			return aliasValue(DB_NAME(code));
+
+		 case DB_ABSTR:
+			return newVal(NV_CLOS, code, env);
+
+		 case DB_APPL:
+			if(!enter() || !(f = eval(DB_L(code), env)))
+				return NULL;
+			nest--;
+
+			if(f->kind == NV_NEUTRAL || f->compiled)
+				return apply(f, argument(DB_R(code), env));
+
+			// beta-reduction
+			reductions++;
+			env = newEnv(argument(DB_R(code), env), f->env);
+			code = DB_R(f->code);
+			break;
+
+		 default:
+			assert(0);
+			return NULL;
+		}
+	}
+}
+
+// apply
+//
+// Returns the value of f (a closure or a neutral value) applied to x, or NULL
+// on error. A call that compiled code leaves to nrTail is performed in the same
+// loop, so tail calls between compiled functions do not nest.
+
+static NVAL *apply(NVAL *f, NVAL *x) {
+	NVAL *r;
+
+	for(;;) {
+		if(f->kind == NV_NEUTRAL)
+			return newNeutral(f->name, f->level, newEnv(x, f->env));
+
+		if(stopped() || !enter())
+			return NULL;
+		reductions++;
+		r = f->compiled
+			? f->native(f->cap, x)
+			: eval(DB_R(f->code), newEnv(x, f->env));
+		nest--;
+
+		if(r != &tailMark)
+			return r;
+		f = tailF;
+		x = tailX;
+	}
+}
+
+// quote
+//
+// Returns the normal form of v, placed under depth abstractions, or DB_NULL on
+// error. Eta-reductions are performed as the abstractions are built.
+//
+// The last argument of a neutral value is quoted in the same loop, so long
+// chains (f (f (f ... x))) like numerals do not nest. The applications of the
+// chain are kept in the chain array, their loose fields are computed at the end.
+
+static DBTERM *chain = NULL;
+static int chainNo, chainSize = 0;
+
+static DBTERM quoteClos(NVAL *v, int depth);
+static DBTERM quoteArgs(NVAL *v, NENV *args, int depth);
+
+static DBTERM quote(NVAL *v, int depth) {
+	int base = chainNo, i;
+	DBTERM t, l;
+
+	if(!enter())
+		return DB_NULL;
+
+	for(;;) {
+		if(!(v = force(v)))
+			return DB_NULL;
+
+		if(v->kind != NV_NEUTRAL || !v->env) {
+			t = v->kind == NV_NEUTRAL
+				? quoteArgs(v, NULL, depth)
+				: quoteClos(v, depth);
+			if(!t)
+				return DB_NULL;
+			break;
+		}
+
+		if(!(l = quoteArgs(v, v->env->next, depth)))
+			return DB_NULL;
+
+		if(chainNo == chainSize &&
+			!(chain = realloc(chain, (chainSize = chainSize ? 2 * chainSize : 256) * sizeof(DBTERM)))) {
+			fprintf(stderr, "Error: out of memory.\n");
+			exit(1);
+		}
+		t = dbNew(DB_APPL);
+		DB_L(t) = l;
+		chain[chainNo++] = t;
+		v = v->env->v;
+	}
+
+	// fill in the chain, from the innermost application
+	for(i = chainNo - 1; i >= base; i--) {
+		DB_R(chain[i]) = t;
+		DB_LOOSE(chain[i]) = LOOSE_APPL(DB_LOOSE(DB_L(chain[i])), DB_LOOSE(t));
+		t = chain[i];
+	}
+	chainNo = base;
+
+	nest--;
+	return t;
+}
+
+// quoteClos
+//
+// Returns the normal form of closure v
+
+static DBTERM quoteClos(NVAL *v, int depth) {
+	DBTERM body, m;
+	NVAL *x, *b;
+
+	x = newNeutral(NULL, depth, NULL);
+	if(v->compiled) {
+		if((b = v->native(v->cap, x)) == &tailMark)
+			b = apply(tailF, tailX);
+	} else
+		b = eval(DB_R(v->code), newEnv(x, v->env));
+
+	if(!b || !(body = quote(b, depth + 1)))
+		return DB_NULL;
+
+	// \.M 0 -> M  if 0 not free in M
+	if(DB_TYPE(body) == DB_APPL &&
+		DB_TYPE(DB_R(body)) == DB_VAR &&
+		DB_INDEX(DB_R(body)) == 0 &&
+		!dbIsFree(DB_L(body), 0)) {
+
+		m = DB_L(body);
+		dbFreeNode(DB_R(body));
+		dbFreeNode(body);
+		dbShift(m, -1, 0);
+		return m;
+	}
+
+	return dbNewAbstr(v->compiled ? v->name : DB_NAME(v->code), body);
+}
+
+// quoteArgs
+//
+// Returns the normal form of neutral value v applied to args (last one first)
+
+static DBTERM quoteArgs(NVAL *v, NENV *args, int depth) {
+	DBTERM l, r;
+
+	if(!args) {
+		if(v->level >= 0)
+			return dbNewVar(depth - 1 - v->level);
+
+		l = dbNew(DB_FREE);
+		DB_SETNAME(l, v->name);
+		return l;
+	}
+
+	if(!(l = quoteArgs(v, args->next, depth)) ||
+		!(r = quote(args->v, depth)))
+		return DB_NULL;
+
+	return dbNewAppl(l, r);
+}
+
+
+// ------- Engine interface --------
+
+static void *nbeStart(TERM *t) {
+	NSTATE *st = arenaAlloc(sizeof(NSTATE));
+
+	st->code = dbFromTerm(t);
+	st->t = t;
+	st->res = DB_NULL;
+	st->shown = NULL;
+	return st;
+}
+
+// nbeStep
+//
+// Computes the normal form in one go, returns the number of beta-reductions
+// performed
+
+static int nbeStep(void *state) {
+	NSTATE *st = state;
+	NVAL *v;
+
+	if(st->res)
+		return 0;
+
+	reductions = nest = chainNo = 0;
+	traced = trace;
+	if(!(v = eval(st->code, NULL)) ||
+		!(st->res = quote(v, 0)))
+		return memExceeded && reductions ? reductions : -1;
+
+	return reductions;
+}
+
+static TERM *nbeTerm(void *state) {
+	NSTATE *st = state;
+
+	if(!st->res)
+		return st->t;
+
+	termFree(st->shown);
+	st->shown = dbToTerm(st->res);
+	return st->shown;
+}
+
+ENGINE nbeEngine = { "nbe", nbeStart, nbeStep, nbeTerm, NULL };
+
+
+// ------- Runtime of compiled code (see native.h) --------
+
+// nrEnv
+//
+// Returns room for n captured values. A block holds at most 8 (the largest size
+// of arenaAlloc), if there are more the last slot points to the next block.
+
+static void **nrEnv(int n) {
+	void **e = arenaAlloc((n > 8 ? 8 : n) * sizeof(void*));
+
+	if(n > 8)
+		e[7] = nrEnv(n - 7);
+	return e;
+}
+
+static void *nrClos(NATIVE_CODE code, char *name, void **cap) {
+	NVAL *v = newVal(NV_CLOS, DB_NULL, NULL);
+
+	v->compiled = 1;
+	v->native = code;
+	v->name = name;
+	v->cap = cap;
+	return v;
+}
+
+static void *nrThunk(NATIVE_CODE code, void **cap) {
+	NVAL *v = newVal(NV_THUNK, DB_NULL, NULL);
+
+	v->compiled = 1;
+	v->native = code;
+	v->cap = cap;
+	return v;
+}
+
+static void *nrAlias(char *id) {
+	return aliasValue(id);
+}
+
+// nrAliasArg
+//
+// Returns the value of an alias if it is already computed, a thunk otherwise
+
+static void *nrAliasArg(char *id) {
+	DECL *decl = getDecl(id);
+	NVAL *v;
+
+	if(decl && decl->valueQuery == queryNo)
+		return decl->value;
+
+	v = newVal(NV_THUNK, DB_NULL, NULL);
+	v->name = id;
+	return v;
+}
+
+static void *nrFreeVar(char *name) {
+	return newNeutral(name, -1, NULL);
+}
+
+static void *nrForce(void *v) {
+	return force(v);
+}
+
+static void *nrApply(void *f, void *x) {
+	return apply(f, x);
+}
+
+// nrTail
+//
+// Leaves the application of f to x to the apply that called the compiled code
+
+static void *nrTail(void *f, void *x) {
+	tailF = f;
+	tailX = x;
+	return &tailMark;
+}
+
+NATIVE_RT nbeNative = {
+	nrEnv, nrClos, nrThunk, nrAlias, nrAliasArg, nrFreeVar, nrForce, nrApply, nrTail
+};
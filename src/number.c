@@ -0,0 +1,419 @@
+// vim:noet:ts=3
+
+/* Arbitrary precision natural numbers
+
+	Copyright (C) 2004-8 Kostas Chatzikokolakis
+	This file is part of LCI
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details. */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+
+#include "number.h"
+#include "termalloc.h"
+
+
+// bigNew
+//
+// Returns a number of size digits (to be filled by the caller)
+
+static BIGNUM *bigNew(int size) {
+	BIGNUM *b = arenaAllocBig(offsetof(BIGNUM, digit) + (size > 0 ? size : 1) * sizeof(unsigned));
+
+	b->size = size;
+	return b;
+}
+
+// trim
+//
+// Returns the size of the n digits d without their leading zeros
+
+static int trim(unsigned *d, int n) {
+	while(n > 0 && d[n-1] == 0)
+		n--;
+	return n;
+}
+
+// cmpDigits
+//
+// Compares the numbers with digits a and b (without leading zeros), returns
+// -1, 0 or 1
+
+static int cmpDigits(unsigned *a, int na, unsigned *b, int nb) {
+	int i;
+
+	if(na != nb)
+		return na < nb ? -1 : 1;
+
+	for(i = na - 1; i >= 0; i--)
+		if(a[i] != b[i])
+			return a[i] < b[i] ? -1 : 1;
+
+	return 0;
+}
+
+// subDigits
+//
+// Subtracts b from a (a >= b) in place, returns the new size of a
+
+static int subDigits(unsigned *a, int na, unsigned *b, int nb) {
+	long long cur;
+	int i, borrow = 0;
+
+	for(i = 0; i < na; i++) {
+		cur = (long long)a[i] - (i < nb ? b[i] : 0) - borrow;
+		borrow = cur < 0;
+		a[i] = borrow ? cur + BIG_BASE : cur;
+	}
+
+	return trim(a, na);
+}
+
+// mulSmall
+//
+// Writes b * q to t (room for nb+1 digits), returns its size
+
+static int mulSmall(unsigned *b, int nb, unsigned q, unsigned *t) {
+	unsigned long long cur, carry = 0;
+	int i;
+
+	for(i = 0; i < nb; i++) {
+		cur = (unsigned long long)b[i] * q + carry;
+		t[i] = cur % BIG_BASE;
+		carry = cur / BIG_BASE;
+	}
+	t[nb] = carry;
+
+	return trim(t, nb + 1);
+}
+
+// bigFromString
+//
+// Returns the number written in decimal in s
+
+BIGNUM *bigFromString(char *s) {
+	int len, n, i, j, start;
+	unsigned d;
+	BIGNUM *b;
+
+	while(*s == '0') s++;
+	len = strlen(s);
+	n = (len + BIG_DECIMALS - 1) / BIG_DECIMALS;
+	b = bigNew(n);
+
+	// digit i is made of the characters [len - 9(i+1), len - 9i)
+	for(i = 0; i < n; i++) {
+		start = len - BIG_DECIMALS * (i + 1);
+		for(d = 0, j = start > 0 ? start : 0; j < len - BIG_DECIMALS * i; j++)
+			d = d * 10 + (s[j] - '0');
+		b->digit[i] = d;
+	}
+
+	return b;
+}
+
+// bigFromInt
+//
+// Returns the number n (n >= 0)
+
+BIGNUM *bigFromInt(int n) {
+	BIGNUM *b = bigNew(2);
+
+	b->digit[0] = n % BIG_BASE;
+	b->digit[1] = n / BIG_BASE;
+	b->size = trim(b->digit, 2);
+	return b;
+}
+
+// bigToInt
+//
+// Returns the value of b, or -1 if it does not fit in an int
+
+int bigToInt(BIGNUM *b) {
+	unsigned long long v = 0;
+	int i;
+
+	if(b->size > 2) return -1;
+
+	for(i = b->size - 1; i >= 0; i--)
+		v = v * BIG_BASE + b->digit[i];
+
+	return v <= INT_MAX ? (int)v : -1;
+}
+
+// bigClone
+//
+// Returns a copy of b in the current arena
+
+BIGNUM *bigClone(BIGNUM *b) {
+	BIGNUM *c = bigNew(b->size);
+
+	memcpy(c->digit, b->digit, b->size * sizeof(unsigned));
+	return c;
+}
+
+// bigCmp
+//
+// Compares a and b, returns -1, 0 or 1
+
+int bigCmp(BIGNUM *a, BIGNUM *b) {
+	return cmpDigits(a->digit, a->size, b->digit, b->size);
+}
+
+// bigAdd
+//
+// Returns a + b
+
+BIGNUM *bigAdd(BIGNUM *a, BIGNUM *b) {
+	int i, n = a->size > b->size ? a->size : b->size;
+	BIGNUM *r = bigNew(n + 1);
+	unsigned cur, carry = 0;
+
+	for(i = 0; i < n; i++) {
+		cur = (i < a->size ? a->digit[i] : 0) + (i < b->size ? b->digit[i] : 0) + carry;
+		carry = cur >= BIG_BASE;
+		r->digit[i] = carry ? cur - BIG_BASE : cur;
+	}
+	r->digit[n] = carry;
+
+	r->size = trim(r->digit, n + 1);
+	return r;
+}
+
+// bigMonus
+//
+// Returns a - b, or 0 if b > a
+
+BIGNUM *bigMonus(BIGNUM *a, BIGNUM *b) {
+	BIGNUM *r;
+
+	if(bigCmp(a, b) <= 0)
+		return bigNew(0);
+
+	r = bigClone(a);
+	r->size = subDigits(r->digit, r->size, b->digit, b->size);
+	return r;
+}
+
+// bigMul
+//
+// Returns a * b, or NULL if it would have more than BIG_MAXSIZE digits, take
+// more than BIG_MAXWORK digit products (the time of a single step is bounded)
+// or exceed the memory limit (see arenaRoom)
+
+BIGNUM *bigMul(BIGNUM *a, BIGNUM *b) {
+	unsigned long long cur, carry;
+	int i, j, n = a->size + b->size;
+	BIGNUM *r;
+
+	if(a->size == 0 || b->size == 0)
+		return bigNew(0);
+	if(n > BIG_MAXSIZE || (long long)a->size * b->size > BIG_MAXWORK ||
+		!arenaRoom(n * sizeof(unsigned)))
+		return NULL;
+
+	r = bigNew(n);
+	memset(r->digit, 0, n * sizeof(unsigned));
+
+	for(i = 0; i < a->size; i++) {
+		for(carry = 0, j = 0; j < b->size; j++) {
+			cur = r->digit[i+j] + (unsigned long long)a->digit[i] * b->digit[j] + carry;
+			r->digit[i+j] = cur % BIG_BASE;
+			carry = cur / BIG_BASE;
+		}
+		r->digit[i + b->size] = carry;
+	}
+
+	r->size = trim(r->digit, n);
+	return r;
+}
+
+// divMod
+//
+// Computes the quotient q and the remainder r of a / b (b > 0). Each digit of
+// the quotient is found by a binary search, which is simple and fast enough
+// for the sizes of numbers used in lambda terms. Returns 0 if it would take
+// more than BIG_MAXWORK digit products (about 32 products by each digit of b
+// for each digit of the quotient, see bigMul) or exceed the memory limit,
+// otherwise 1.
+
+static int divMod(BIGNUM *a, BIGNUM *b, BIGNUM **q, BIGNUM **r) {
+	unsigned long long cur, rem = 0;
+	unsigned *t, lo, hi, mid;
+	BIGNUM *quot, *rest;
+	int i, n, nt;
+
+	if(bigCmp(a, b) < 0) {
+		*q = bigNew(0);
+		*r = a;
+		return 1;
+	}
+
+	if((b->size > 1 &&
+		 (long long)(a->size - b->size + 1) * b->size * 32 > BIG_MAXWORK) ||
+		!arenaRoom((a->size + b->size + 2) * sizeof(unsigned)))
+		return 0;
+
+	quot = bigNew(a->size);
+
+	if(b->size == 1) {
+		for(i = a->size - 1; i >= 0; i--) {
+			cur = rem * BIG_BASE + a->digit[i];
+			quot->digit[i] = cur / b->digit[0];
+			rem = cur % b->digit[0];
+		}
+		quot->size = trim(quot->digit, a->size);
+		*q = quot;
+		*r = bigFromInt(rem);
+		return 1;
+	}
+
+	// the remainder so far and b * (digit of the quotient)
+	rest = bigNew(b->size + 1);
+	if(!(t = malloc((b->size + 1) * sizeof(unsigned)))) {
+		fprintf(stderr, "Error: out of memory.\n");
+		exit(1);
+	}
+
+	for(n = 0, i = a->size - 1; i >= 0; i--) {
+		memmove(rest->digit + 1, rest->digit, n * sizeof(unsigned));
+		rest->digit[0] = a->digit[i];
+		n = trim(rest->digit, n + 1);
+
+		for(lo = 0, hi = BIG_BASE - 1; lo < hi; ) {
+			mid = lo + (hi - lo + 1) / 2;
+			nt = mulSmall(b->digit, b->size, mid, t);
+			if(cmpDigits(t, nt, rest->digit, n) <= 0)
+				lo = mid;
+			else
+				hi = mid - 1;
+		}
+
+		quot->digit[i] = lo;
+		nt = mulSmall(b->digit, b->size, lo, t);
+		n = subDigits(rest->digit, n, t, nt);
+	}
+
+	free(t);
+	quot->size = trim(quot->digit, a->size);
+	rest->size = n;
+	*q = quot;
+	*r = rest;
+	return 1;
+}
+
+// bigDivide
+//
+// Returns a / b (integer division), or NULL if b is 0 or the division would
+// be too long (see divMod)
+
+BIGNUM *bigDivide(BIGNUM *a, BIGNUM *b) {
+	BIGNUM *q, *r;
+
+	if(b->size == 0 || !divMod(a, b, &q, &r)) return NULL;
+	return q;
+}
+
+// bigModulus
+//
+// Returns a mod b, or NULL if b is 0 or the division would be too long (see
+// divMod)
+
+BIGNUM *bigModulus(BIGNUM *a, BIGNUM *b) {
+	BIGNUM *q, *r;
+
+	if(b->size == 0 || !divMod(a, b, &q, &r)) return NULL;
+	return r;
+}
+
+// bigPower
+//
+// Returns a^b (0^0 = 1, as for Church numerals), or NULL if it would have more
+// than BIG_MAXSIZE digits or its last squaring would be too long (see bigMul).
+// The size of the result is estimated before any multiplication.
+
+BIGNUM *bigPower(BIGNUM *a, BIGNUM *b) {
+	BIGNUM *r = bigFromInt(1);
+	int e = bigToInt(b);
+	double size;
+
+	if(b->size == 0 || (a->size == 1 && a->digit[0] == 1))
+		return r;
+	if(a->size == 0)
+		return a;
+	if(e < 0)
+		return NULL;
+
+	// a^e has about e * log10(a) decimal digits
+	size = e * ((a->size - 1) * BIG_DECIMALS + log10(a->digit[a->size-1])) / BIG_DECIMALS + 1;
+	if(size > BIG_MAXSIZE || (size / 2) * (size / 2) > BIG_MAXWORK)
+		return NULL;
+
+	// square and multiply
+	for(;;) {
+		if(e & 1 && !(r = bigMul(r, a)))
+			return NULL;
+		if((e >>= 1) == 0)
+			return r;
+		if(!(a = bigMul(a, a)))
+			return NULL;
+	}
+}
+
+// bigPrint
+//
+// Prints b in decimal
+
+void bigPrint(BIGNUM *b) {
+	int i;
+
+	if(b->size == 0) {
+		putchar('0');
+		return;
+	}
+
+	printf("%u", b->digit[b->size-1]);
+	for(i = b->size - 2; i >= 0; i--)
+		printf("%0*u", BIG_DECIMALS, b->digit[i]);
+}
+
+// bigToString
+//
+// Returns b in decimal, in a string allocated by malloc
+
+char *bigToString(BIGNUM *b) {
+	char *s = malloc(b->size * BIG_DECIMALS + 2), *p = s;
+	int i;
+
+	if(!s) {
+		fprintf(stderr, "Error: out of memory.\n");
+		exit(1);
+	}
+
+	if(b->size == 0) {
+		strcpy(s, "0");
+		return s;
+	}
+
+	p += sprintf(p, "%u", b->digit[b->size-1]);
+	for(i = b->size - 2; i >= 0; i--)
+		p += sprintf(p, "%0*u", BIG_DECIMALS, b->digit[i]);
+
+	return s;
+}
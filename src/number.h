@@ -0,0 +1,56 @@
+// vim:noet:ts=3
+
+/* Declarations for number.c
+
+	Copyright (C) 2004-8 Kostas Chatzikokolakis
+	This file is part of LCI
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details. */
+
+#ifndef NUMBER_H
+#define NUMBER_H
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#define BIG_BASE		1000000000		// each digit holds 9 decimal digits
+#define BIG_DECIMALS	9
+#define BIG_MAXSIZE	(1 << 24)		// digits of the largest number computed
+#define BIG_MAXWORK	(1 << 28)		// digit products of the largest multiplication
+
+// Natural numbers of any size. The digits are stored in base BIG_BASE, least
+// significant first, so that printing and parsing take linear time. Numbers are
+// allocated with arenaAllocBig in the current arena and are never modified,
+// they can be shared by any number of terms of the same arena and are released
+// together with it.
+typedef struct tag_bignum {
+	int size;								// number of digits, the last one is not 0 (0 has none)
+	unsigned digit[1];
+} BIGNUM;
+
+
+BIGNUM *bigFromString(char *s);
+BIGNUM *bigFromInt(int n);
+int bigToInt(BIGNUM *b);
+BIGNUM *bigClone(BIGNUM *b);
+int bigCmp(BIGNUM *a, BIGNUM *b);
+BIGNUM *bigAdd(BIGNUM *a, BIGNUM *b);
+BIGNUM *bigMonus(BIGNUM *a, BIGNUM *b);
+BIGNUM *bigMul(BIGNUM *a, BIGNUM *b);
+BIGNUM *bigDivide(BIGNUM *a, BIGNUM *b);
+BIGNUM *bigModulus(BIGNUM *a, BIGNUM *b);
+BIGNUM *bigPower(BIGNUM *a, BIGNUM *b);
+void bigPrint(BIGNUM *b);
+char *bigToString(BIGNUM *b);
+
+
+#endif
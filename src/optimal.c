@@ -0,0 +1,922 @@
+// vim:noet:ts=3
+
+/* Optimal reduction with interaction nets
+
+	Copyright (C) 2004-8 Kostas Chatzikokolakis
+	This file is part of LCI
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details. */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include "optimal.h"
+#include "dbterm.h"
+#include "decllist.h"
+#include "termalloc.h"
+#include "run.h"
+
+
+// Lamping's algorithm: the term is translated into a sharing graph, an
+// interaction net whose nodes have a principal port (0) and up to two
+// auxiliary ones, and a level:
+//		LAM  (0: the abstraction, 1: its body, 2: its variable)
+//		APP  (0: the function, 1: the result, 2: the argument)
+//		FAN  (0: the shared side, 1 and 2: the two copies)
+//		BRA, CRO  brackets and croissants (0: the binder's side), they mark
+//		where the occurrence of a variable enters an argument and where it is used
+//		ERA  erases what is connected to it
+//		FREE, ALIAS  free variables and aliases, an alias is expanded when it is
+//		applied and copied or erased as a whole otherwise
+//
+// The function of an application is at the level of the application, the
+// argument one level higher. A variable occurrence gets a croissant at its level
+// and a bracket for each argument it is in, below its abstraction's level. The
+// occurrences in the same argument share its bracket (so a numeral has as many
+// brackets as occurrences) and are shared by fans at the argument's level, or at
+// the level of the abstraction.
+//
+// Two nodes interact when their principal ports are connected. An abstraction
+// and an application make a beta-reduction, two control nodes (FAN, BRA, CRO)
+// of the same kind and level annihilate, otherwise the node of the higher level
+// passes through the control node: it is copied by a fan, its level decreases
+// by a croissant and increases by a bracket. A redex is never copied, which
+// makes the number of beta-reductions optimal.
+//
+// The net is reduced lazily while it is read back, so only the redexes the
+// normal form needs are reduced (a part that a fan shares is reduced once, but
+// read back for each copy). The read back follows the context semantics of the
+// net: a context keeps one stack per level, a fan pushes the copy it is entered
+// from, a bracket merges two levels and a croissant adds one, and the other way
+// round when they are passed from the principal port. A step computes the whole
+// normal form, it returns the number of beta-reductions and the number of all
+// interactions is printed next to it.
+
+typedef enum { IN_ROOT, IN_LAM, IN_APP, IN_FAN, IN_BRA, IN_CRO, IN_ERA, IN_FREE, IN_ALIAS } INODE_KIND;
+
+typedef struct {
+	INODE_KIND kind;
+	int level;
+	char *name;
+	int port[3];							// the port each port is connected to
+} INODE;
+
+// a port is the node's index with the slot in the last two bits (0 is no port)
+#define PORT(n, s)		((n) << 2 | (s))
+#define PNODE(p)			((p) >> 2)
+#define PSLOT(p)			((p) & 3)
+#define TARGET(p)			(nodes[PNODE(p)].port[PSLOT(p)])
+
+#define IS_CONTROL(n)	(nodes[n].kind == IN_FAN || nodes[n].kind == IN_BRA || nodes[n].kind == IN_CRO)
+
+// Contexts of the read back: a list of the levels that are not empty, each one
+// a stack and the number of empty levels before it (missing levels are empty
+// too). An item is the copy a fan was entered from, or a whole level merged by
+// a bracket (slot 0).
+typedef struct tag_citem {
+	int slot;
+	struct tag_citem *packed;
+	struct tag_citem *next;
+} CITEM;
+
+typedef struct tag_clevel {
+	CITEM *s;
+	int gap;
+	struct tag_clevel *next;
+} CLEVEL;
+
+// the abstractions passed on the way from the root (innermost first)
+typedef struct tag_binder {
+	int node;
+	CLEVEL *ctx;
+	struct tag_binder *next;
+} BINDER;
+
+// a bracket created by translate, for the variable of abstraction lam
+typedef struct {
+	int lam;
+	int port;
+	int next;
+} BRACKET;
+
+// the contexts are allocated from a pool of chunks, see poolAlloc
+#define POOL_CHUNK		(64 * 1024)
+
+typedef struct tag_pchunk {
+	struct tag_pchunk *next;
+	double data[POOL_CHUNK / sizeof(double)];
+} PCHUNK;
+
+typedef struct {
+	TERM *t;
+	DBTERM res;								// the normal form, once computed
+	TERM *shown;							// last term returned by optimalTerm
+	int interactions;
+} OSTATE;
+
+#define HEAP_CHARGE		1024
+#define RB_NEST_MAX		20000
+
+static INODE *nodes = NULL;
+static int nodeNo, nodeSize = 0, freeNodes;
+static int *work = NULL, *binders = NULL;
+static int workNo = 0, workSize = 0, binderSize = 0;
+static int *lams = NULL;				// abstractions created by translate
+static int lamNo, lamSize = 0;
+static BRACKET *brackets = NULL;		// brackets of the arguments, see bracketAdd
+static int *scopes = NULL;				// the list of each level
+static int bracketNo, bracketSize = 0, scopeSize = 0, baseLevel;
+static int reductions, interactions, nest;
+static int traced;						// trace was on when the step started
+static PCHUNK *pool = NULL, *poolCur;
+static char *poolTop;
+static int poolNo, poolCharged;		// chunks in use, and charged to the query arena
+
+
+// grow
+//
+// Makes room for one more element in array *a of *size elements of elsize
+// bytes, if no is the number of elements in use.
+
+static void grow(void **a, int *size, int no, size_t elsize) {
+	if(no < *size)
+		return;
+
+	*size = *size ? 2 * *size : 1024;
+	if(!(*a = realloc(*a, *size * elsize))) {
+		fprintf(stderr, "Error: out of memory.\n");
+		exit(1);
+	}
+}
+
+// newNode
+//
+// Returns a new node, its ports are not connected. New nodes are charged to the
+// query arena (HEAP_CHARGE at a time), so that the memory limit applies.
+
+static int newNode(INODE_KIND kind, int level) {
+	int n;
+
+	if(freeNodes) {
+		n = freeNodes;
+		freeNodes = nodes[n].port[0];
+	} else {
+		grow((void**)&nodes, &nodeSize, nodeNo, sizeof(INODE));
+		if(nodeNo % HEAP_CHARGE == 0)
+			arenaCharge(AR_QUERY, HEAP_CHARGE * sizeof(INODE));
+		n = nodeNo++;
+	}
+
+	nodes[n].kind = kind;
+	nodes[n].level = level;
+	nodes[n].port[0] = nodes[n].port[1] = nodes[n].port[2] = 0;
+	return n;
+}
+
+// copyNode
+//
+// Returns a new node of the same kind, level and name as n
+
+static int copyNode(int n) {
+	int c = newNode(nodes[n].kind, nodes[n].level);
+
+	nodes[c].name = nodes[n].name;
+	return c;
+}
+
+static void freeNode(int n) {
+	nodes[n].port[0] = freeNodes;
+	freeNodes = n;
+}
+
+// auxNo
+//
+// Returns the number of auxiliary ports of node n
+
+static int auxNo(int n) {
+	switch(nodes[n].kind) {
+	 case IN_LAM:
+	 case IN_APP:
+	 case IN_FAN:
+		return 2;
+	 case IN_BRA:
+	 case IN_CRO:
+		return 1;
+	 default:
+		return 0;
+	}
+}
+
+// wire
+//
+// Connects ports a and b
+
+static void wire(int a, int b) {
+	TARGET(a) = b;
+	TARGET(b) = a;
+}
+
+
+// ------- Translation --------
+
+// share
+//
+// Connects the occurrence of a variable on port out to port p (an abstraction's
+// variable or a bracket), the occurrences that reach p are shared by fans of
+// the given level
+
+static void share(int p, int out, int level) {
+	int f;
+
+	if(TARGET(p)) {
+		f = newNode(IN_FAN, level);
+		wire(PORT(f, 1), TARGET(p));
+		wire(PORT(f, 0), p);
+		wire(PORT(f, 2), out);
+	} else
+		wire(p, out);
+}
+
+// bracketGet, bracketAdd
+//
+// Find and record the bracket through which the occurrences of abstraction lam
+// leave the argument at the given level. The brackets of an argument are kept
+// until translate enters another argument at the same level.
+
+static int bracketGet(int lam, int level) {
+	int b;
+
+	for(b = scopes[level - baseLevel]; b; b = brackets[b].next)
+		if(brackets[b].lam == lam)
+			return brackets[b].port;
+	return 0;
+}
+
+static void bracketAdd(int lam, int level, int port) {
+	grow((void**)&brackets, &bracketSize, bracketNo, sizeof(BRACKET));
+	brackets[bracketNo].lam = lam;
+	brackets[bracketNo].port = port;
+	brackets[bracketNo].next = scopes[level - baseLevel];
+	scopes[level - baseLevel] = bracketNo++;
+}
+
+// translate
+//
+// Builds the net of t (under depth abstractions) at the given level and
+// connects its root to port out. Only the left side of an application nests.
+
+static void translate(DBTERM t, int out, int depth, int level) {
+	int n, l, p, i;
+
+	for(;;) {
+		switch(DB_TYPE(t)) {
+		 case DB_VAR:
+			// a croissant at the occurrence and a bracket for each argument
+			// between it and the abstraction, the occurrences in the same
+			// argument share its bracket
+			l = binders[depth - 1 - DB_INDEX(t)];
+			n = newNode(IN_CRO, level);
+			wire(PORT(n, 1), out);
+			out = PORT(n, 0);
+			for(i = level; i > nodes[l].level; i--) {
+				if((p = bracketGet(l, i))) {
+					share(p, out, i);
+					return;
+				}
+				n = newNode(IN_BRA, i - 1);
+				bracketAdd(l, i, PORT(n, 1));
+				wire(PORT(n, 1), out);
+				out = PORT(n, 0);
+			}
+			share(PORT(l, 2), out, nodes[l].level);
+			return;
+
+		 case DB_FREE:
+		 case DB_ALIAS:
+			n = newNode(DB_TYPE(t) == DB_FREE ? IN_FREE : IN_ALIAS, level);
+			nodes[n].name = DB_NAME(t);
+			wire(PORT(n, 0), out);
+			return;
+
+		 case DB_ABSTR:
+			n = newNode(IN_LAM, level);
+			nodes[n].name = DB_NAME(t);
+			wire(PORT(n, 0), out);
+
+			grow((void**)&binders, &binderSize, depth, sizeof(int));
+			binders[depth++] = n;
+			grow((void**)&lams, &lamSize, lamNo, sizeof(int));
+			lams[lamNo++] = n;
+
+			out = PORT(n, 1);
+			t = DB_R(t);
+			break;
+
+		 case DB_APPL:
+			n = newNode(IN_APP, level);
+			wire(PORT(n, 1), out);
+			translate(DB_L(t), PORT(n, 0), depth, level);
+			out = PORT(n, 2);
+			t = DB_R(t);
+
+			// a new argument, it has no brackets yet
+			level++;
+			grow((void**)&scopes, &scopeSize, level - baseLevel, sizeof(int));
+			scopes[level - baseLevel] = 0;
+			break;
+
+		 default:
+			assert(0);
+			return;
+		}
+	}
+}
+
+// buildNet
+//
+// Builds the net of t at the given level, connected to port out. Unused
+// variables are erased.
+
+static void buildNet(DBTERM t, int out, int level) {
+	int i, e;
+
+	lamNo = 0;
+	bracketNo = 1;
+	baseLevel = level;
+	translate(t, out, 0, level);
+
+	for(i = 0; i < lamNo; i++)
+		if(!nodes[lams[i]].port[2]) {
+			e = newNode(IN_ERA, 0);
+			wire(PORT(e, 0), PORT(lams[i], 2));
+		}
+}
+
+// expand
+//
+// Replaces alias node a by the net of its declaration. Returns 0 if it is not declared.
+
+static int expand(int a) {
+	char *name = nodes[a].name;
+	int out = nodes[a].port[0], level = nodes[a].level;
+
+	if(!getDecl(name)) {
+		printf("Error: Alias %s is not declared.\n", name);
+		return 0;
+	}
+
+	freeNode(a);
+	buildNet(dbFromDecl(name), out, level);
+	return 1;
+}
+
+
+// ------- Reduction --------
+
+// annihilate
+//
+// Removes a and b, connecting what was on their auxiliary ports pairwise.
+// For an abstraction and an application this is a beta-reduction.
+
+static void annihilate(int a, int b) {
+	int i;
+
+	// the targets are read one at a time, so that wires between the auxiliary
+	// ports of a and b are followed correctly
+	for(i = 1; i <= auxNo(a); i++)
+		wire(TARGET(PORT(a, i)), TARGET(PORT(b, i)));
+
+	freeNode(a);
+	freeNode(b);
+}
+
+// pass
+//
+// Node x passes through control node c: x is copied to each auxiliary port of
+// c (with its level changed by a bracket or a croissant) and c to each
+// auxiliary port of x.
+
+static void pass(int c, int x) {
+	int cn = auxNo(c), xn = auxNo(x), i, j,
+		 cc[2], xc[2];
+
+	for(i = 0; i < cn; i++) {
+		xc[i] = copyNode(x);
+		if(nodes[c].kind == IN_BRA)
+			nodes[xc[i]].level++;
+		else if(nodes[c].kind == IN_CRO)
+			nodes[xc[i]].level--;
+	}
+	for(j = 0; j < xn; j++)
+		cc[j] = copyNode(c);
+
+	for(i = 0; i < cn; i++)
+		wire(PORT(xc[i], 0), TARGET(PORT(c, i + 1)));
+	for(j = 0; j < xn; j++)
+		wire(PORT(cc[j], 0), TARGET(PORT(x, j + 1)));
+
+	for(i = 0; i < cn; i++)
+		for(j = 0; j < xn; j++)
+			wire(PORT(xc[i], j + 1), PORT(cc[j], i + 1));
+
+	freeNode(c);
+	freeNode(x);
+}
+
+// erase
+//
+// Eraser e removes node n, the erasure goes on through its auxiliary ports
+
+static void erase(int e, int n) {
+	int i, k;
+
+	for(i = 1; i <= auxNo(n); i++) {
+		k = newNode(IN_ERA, 0);
+		wire(PORT(k, 0), TARGET(PORT(n, i)));
+	}
+
+	freeNode(e);
+	freeNode(n);
+}
+
+// interact
+//
+// Rewrites the pair of nodes a, b connected by their principal ports.
+// Returns 1 on success, 0 if they do not interact and -1 on error.
+
+static int interact(int a, int b) {
+	int t;
+
+	if(nodes[a].kind > nodes[b].kind) {
+		t = a; a = b; b = t;
+	}
+
+	if(nodes[b].kind == IN_ERA)
+		erase(b, a);
+
+	else if(nodes[a].kind == IN_LAM && nodes[b].kind == IN_APP) {
+		if(nodes[a].level != nodes[b].level)
+			goto invalid;
+		annihilate(a, b);
+		reductions++;
+
+	} else if(nodes[a].kind == IN_APP && nodes[b].kind == IN_ALIAS) {
+		if(!expand(b))
+			return -1;
+
+	} else if(IS_CONTROL(a) || IS_CONTROL(b)) {
+		// a is the control node of the lowest level
+		if(IS_CONTROL(b) && (!IS_CONTROL(a) || nodes[b].level < nodes[a].level)) {
+			t = a; a = b; b = t;
+		}
+
+		if(nodes[a].kind == nodes[b].kind && nodes[a].level == nodes[b].level)
+			annihilate(a, b);
+		else if(nodes[b].kind == IN_FREE || nodes[b].level > nodes[a].level)
+			pass(a, b);
+		else
+			goto invalid;
+
+	} else
+		return 0;
+
+	interactions++;
+	return 1;
+
+invalid:
+	printf("Error: the net of this term cannot be reduced, try another engine.\n");
+	return -1;
+}
+
+// whnf
+//
+// Reduces the net connected to port p until its head is found: an abstraction,
+// a variable or a control node seen from its principal port. The ports that led
+// to the nodes passed on the way are kept in work. Returns 0 on success, -1 on
+// error.
+
+static int whnf(int p) {
+	int base = workNo, q, n, r;
+
+	for(;;) {
+		// the normal form is computed in one step, so a SIGINT (which enables
+		// trace) cannot stop the query between steps
+		if(trace && !traced) {
+			printf("Error: interrupted after %d reductions.\n", reductions);
+			return -1;
+		}
+		if(memExceeded)
+			return -1;
+
+		q = TARGET(p);
+		n = PNODE(q);
+
+		if(PSLOT(q) == 0) {
+			if(PSLOT(p) == 0) {
+				// an active pair, once it is rewritten go back to the port that led here
+				if((r = interact(PNODE(p), n)) < 0)
+					return -1;
+				if(r) {
+					p = work[--workNo];
+					continue;
+				}
+
+			} else if(nodes[n].kind == IN_ALIAS) {
+				// an alias as a value, it is needed in full
+				if(!expand(n))
+					return -1;
+				continue;
+			}
+			break;
+		}
+
+		// a variable is a head, an application or a control node is passed
+		if(nodes[n].kind == IN_LAM)
+			break;
+
+		grow((void**)&work, &workSize, workNo, sizeof(int));
+		work[workNo++] = p;
+		p = PORT(n, 0);
+	}
+
+	workNo = base;
+	return 0;
+}
+
+
+// ------- Read back --------
+
+// poolAlloc
+//
+// Returns a block of size bytes for the read back. The contexts of a part of
+// the term are not needed once it is read, so readback releases the pool to
+// the point where it started (the chunks are kept for reuse). Chunks are
+// charged to the query arena the first time they are used by a query.
+
+static void *poolAlloc(size_t size) {
+	PCHUNK **c;
+	void *p;
+
+	size = (size + sizeof(double) - 1) / sizeof(double) * sizeof(double);
+	if(!poolCur || poolTop + size > (char*)(poolCur + 1)) {
+		c = poolCur ? &poolCur->next : &pool;
+		if(!*c) {
+			if(!(*c = malloc(sizeof(PCHUNK)))) {
+				fprintf(stderr, "Error: out of memory.\n");
+				exit(1);
+			}
+			(*c)->next = NULL;
+		}
+		poolCur = *c;
+		poolTop = (char*)poolCur->data;
+
+		if(++poolNo > poolCharged) {
+			poolCharged = poolNo;
+			arenaCharge(AR_QUERY, sizeof(PCHUNK));
+		}
+	}
+
+	p = poolTop;
+	poolTop += size;
+	return p;
+}
+
+// levelGet
+//
+// Returns the stack of level n of context c
+
+static CITEM *levelGet(CLEVEL *c, int n) {
+	for(; c && n > c->gap; c = c->next)
+		n -= c->gap + 1;
+	return c && n == c->gap ? c->s : NULL;
+}
+
+// levelCopy
+//
+// Copies the levels of *c before level n to *res, sets *c to the rest of the
+// context and *n to the position of level n in the gap of its first level.
+// Returns the link that should point to the rest.
+
+static CLEVEL **levelCopy(CLEVEL **res, CLEVEL **c, int *n) {
+	for(; *c && *n > (*c)->gap; *c = (*c)->next) {
+		*n -= (*c)->gap + 1;
+		*res = poolAlloc(sizeof(CLEVEL));
+		**res = **c;
+		res = &(*res)->next;
+	}
+	return res;
+}
+
+// levelNew
+//
+// Returns a level of stack s after gap empty levels, followed by c
+
+static CLEVEL *levelNew(CITEM *s, int gap, CLEVEL *c) {
+	CLEVEL *l = poolAlloc(sizeof(CLEVEL));
+
+	l->s = s;
+	l->gap = gap;
+	l->next = c;
+	return l;
+}
+
+// levelSet, levelInsert, levelRemove
+//
+// Return context c with level n replaced by s, with a new level s inserted
+// at n, and without level n
+
+static CLEVEL *levelSet(CLEVEL *c, int n, CITEM *s) {
+	CLEVEL *res, **l = levelCopy(&res, &c, &n);
+
+	if(c && n == c->gap) {
+		c = c->next;
+		if(c && !s)
+			c = levelNew(c->s, c->gap + n + 1, c->next);
+	} else if(c && s)
+		c = levelNew(c->s, c->gap - n - 1, c->next);
+
+	*l = s ? levelNew(s, n, c) : c;
+	return res;
+}
+
+static CLEVEL *levelInsert(CLEVEL *c, int n, CITEM *s) {
+	CLEVEL *res, **l = levelCopy(&res, &c, &n);
+
+	if(c)
+		c = levelNew(c->s, s ? c->gap - n : c->gap + 1, c->next);
+
+	*l = s ? levelNew(s, n, c) : c;
+	return res;
+}
+
+static CLEVEL *levelRemove(CLEVEL *c, int n) {
+	CLEVEL *res, **l = levelCopy(&res, &c, &n);
+
+	if(c && n == c->gap)
+		c = c->next ? levelNew(c->next->s, c->next->gap + n, c->next->next) : NULL;
+	else if(c)
+		c = levelNew(c->s, c->gap - 1, c->next);
+
+	*l = c;
+	return res;
+}
+
+// push
+//
+// Returns stack s with a new item on top
+
+static CITEM *push(CITEM *s, int slot, CITEM *packed) {
+	CITEM *i = poolAlloc(sizeof(CITEM));
+
+	i->slot = slot;
+	i->packed = packed;
+	i->next = s;
+	return i;
+}
+
+// stackEqual, contextEqual
+//
+// Compare two stacks, and the first n levels of two contexts
+
+static int stackEqual(CITEM *a, CITEM *b) {
+	for(; a && b; a = a->next, b = b->next)
+		if(a->slot != b->slot || !stackEqual(a->packed, b->packed))
+			return 0;
+	return a == b;
+}
+
+static int contextEqual(CLEVEL *a, CLEVEL *b, int n) {
+	for(; a && a->gap < n; a = a->next, b = b->next) {
+		if(!b || b->gap != a->gap || !stackEqual(a->s, b->s))
+			return 0;
+		n -= a->gap + 1;
+	}
+	return !b || b->gap >= n;
+}
+
+// readback
+//
+// Returns the normal form of the net connected to port p, in context ctx, or
+// DB_NULL on error. The head of each part is reduced before it is read.
+// Eta-reductions are performed as the abstractions are built.
+//
+// The argument of an application is read in the same loop, so long chains
+// (f (f (f ... x))) like numerals do not nest (see quote in nbe.c).
+
+static DBTERM *chain = NULL;
+static int chainNo, chainSize = 0;
+
+static DBTERM readback(int p, CLEVEL *ctx, BINDER *bind) {
+	int base = chainNo, markNo = poolNo, q, n, i, lv;
+	PCHUNK *mark = poolCur;
+	char *markTop = poolTop;
+	DBTERM t, l, body;
+	CITEM *s;
+	BINDER *b;
+
+	if(++nest > RB_NEST_MAX) {
+		printf("Error: evaluation nested too deeply, try another engine.\n");
+		return DB_NULL;
+	}
+
+	for(;;) {
+		if(whnf(p))
+			return DB_NULL;
+
+		q = TARGET(p);
+		n = PNODE(q);
+		lv = nodes[n].level;
+
+		switch(nodes[n].kind) {
+		 case IN_LAM:
+			if(PSLOT(q) == 2) {
+				// the abstraction's copy is the one read in the same context
+				// (its copies differ in the levels below it)
+				for(i = 0, b = bind; b && !(b->node == n && contextEqual(b->ctx, ctx, lv)); b = b->next)
+					i++;
+				if(!b)
+					goto unreadable;
+				t = dbNewVar(i);
+				goto done;
+			}
+
+			b = poolAlloc(sizeof(BINDER));
+			b->node = n;
+			b->ctx = ctx;
+			b->next = bind;
+			if(!(body = readback(PORT(n, 1), ctx, b)))
+				return DB_NULL;
+
+			// \.M 0 -> M  if 0 not free in M
+			if(DB_TYPE(body) == DB_APPL &&
+				DB_TYPE(DB_R(body)) == DB_VAR &&
+				DB_INDEX(DB_R(body)) == 0 &&
+				!dbIsFree(DB_L(body), 0)) {
+
+				t = DB_L(body);
+				dbFreeNode(DB_R(body));
+				dbFreeNode(body);
+				dbShift(t, -1, 0);
+			} else
+				t = dbNewAbstr(nodes[n].name, body);
+			goto done;
+
+		 case IN_APP:
+			if(!(l = readback(PORT(n, 0), ctx, bind)))
+				return DB_NULL;
+
+			grow((void**)&chain, &chainSize, chainNo, sizeof(DBTERM));
+			t = dbNew(DB_APPL);
+			DB_L(t) = l;
+			chain[chainNo++] = t;
+			p = PORT(n, 2);
+			break;
+
+		 case IN_FAN:
+			s = levelGet(ctx, lv);
+			if(PSLOT(q) != 0) {
+				ctx = levelSet(ctx, lv, push(s, PSLOT(q), NULL));
+				p = PORT(n, 0);
+			} else {
+				// leave through the copy the fan was entered from
+				if(!s || !s->slot)
+					goto unreadable;
+				ctx = levelSet(ctx, lv, s->next);
+				p = PORT(n, s->slot);
+			}
+			break;
+
+		 case IN_BRA:
+			s = levelGet(ctx, lv);
+			if(PSLOT(q) != 0) {
+				// level lv+1 becomes an item of level lv
+				ctx = levelSet(ctx, lv, push(s, 0, levelGet(ctx, lv + 1)));
+				ctx = levelRemove(ctx, lv + 1);
+				p = PORT(n, 0);
+			} else {
+				if(!s || s->slot)
+					goto unreadable;
+				ctx = levelSet(ctx, lv, s->next);
+				ctx = levelInsert(ctx, lv + 1, s->packed);
+				p = PORT(n, 1);
+			}
+			break;
+
+		 case IN_CRO:
+			if(PSLOT(q) != 0) {
+				ctx = levelInsert(ctx, lv, NULL);
+				p = PORT(n, 0);
+			} else {
+				ctx = levelRemove(ctx, lv);
+				p = PORT(n, 1);
+			}
+			break;
+
+		 case IN_FREE:
+			t = dbNew(DB_FREE);
+			DB_SETNAME(t, nodes[n].name);
+			goto done;
+
+		 default:
+			goto unreadable;
+		}
+	}
+
+done:
+	// fill in the chain, from the innermost application
+	for(i = chainNo - 1; i >= base; i--) {
+		DB_R(chain[i]) = t;
+		DB_LOOSE(chain[i]) = LOOSE_APPL(DB_LOOSE(DB_L(chain[i])), DB_LOOSE(t));
+		t = chain[i];
+	}
+	chainNo = base;
+
+	poolCur = mark;
+	poolTop = markTop;
+	poolNo = markNo;
+
+	nest--;
+	return t;
+
+unreadable:
+	printf("Error: the net of this term cannot be read back, try another engine.\n");
+	return DB_NULL;
+}
+
+
+// ------- Engine interface --------
+
+static void *optimalStart(TERM *t) {
+	OSTATE *st = arenaAlloc(sizeof(OSTATE));
+
+	st->t = t;
+	st->res = DB_NULL;
+	st->shown = NULL;
+	st->interactions = 0;
+	return st;
+}
+
+// optimalStep
+//
+// Computes the normal form in one go, returns the number of beta-reductions
+// performed
+
+static int optimalStep(void *state) {
+	OSTATE *st = state;
+	int root;
+
+	if(st->res)
+		return 0;
+
+	// the net of the previous query is dropped
+	nodeNo = 1;
+	freeNodes = 0;
+	reductions = interactions = nest = chainNo = 0;
+	poolCur = NULL;
+	poolNo = poolCharged = 0;
+	traced = trace;
+
+	root = newNode(IN_ROOT, 0);
+	buildNet(dbFromTermDecimal(st->t), PORT(root, 1), 0);
+
+	st->res = readback(PORT(root, 1), NULL, NULL);
+	st->interactions = interactions;
+
+	if(!st->res)
+		return memExceeded && reductions ? reductions : -1;
+	return reductions;
+}
+
+static TERM *optimalTerm(void *state) {
+	OSTATE *st = state;
+
+	if(!st->res)
+		return st->t;
+
+	termFree(st->shown);
+	st->shown = dbToTerm(st->res);
+	return st->shown;
+}
+
+// optimalStats
+//
+// Prints the number of interactions, next to the number of reductions
+
+static void optimalStats(void *state) {
+	printf(", %d interactions", ((OSTATE*)state)->interactions);
+}
+
+ENGINE optimalEngine = { "optimal", optimalStart, optimalStep, optimalTerm, optimalStats };
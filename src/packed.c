@@ -0,0 +1,77 @@
+// vim:noet:ts=3
+
+/* Packed lists
+
+	Copyright (C) 2004-8 Kostas Chatzikokolakis
+	This file is part of LCI
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details. */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "packed.h"
+#include "termproc.h"
+
+
+// listNew
+//
+// Returns a list of size elements (to be filled by the caller, see the
+// conditions in packed.h), nf is set. Returns NULL if it would exceed the
+// memory limit (see arenaRoom).
+
+LIST *listNew(int size, LIST_KIND kind) {
+	LIST *l;
+
+	if(!arenaRoom(sizeof(LIST) + size * sizeof(TERM*)))
+		return NULL;
+
+	l = arenaAllocBig(sizeof(LIST) + size * sizeof(TERM*));
+	l->size = size;
+	l->kind = kind;
+	l->nf = 1;
+	l->elem = (TERM**)(l + 1);
+	return l;
+}
+
+// listSlice
+//
+// Returns the size elements of l starting at from (without copying them)
+
+LIST *listSlice(LIST *l, int from, int size) {
+	LIST *s = arenaAllocBig(sizeof(LIST));
+
+	*s = *l;
+	s->size = size;
+	s->elem = l->elem + from;
+	return s;
+}
+
+// listClone
+//
+// Returns a copy of l, and of its elements, in the current arena
+
+LIST *listClone(LIST *l) {
+	LIST *c = listNew(l->size, l->kind);
+	int i;
+
+	c->nf = l->nf;
+	for(i = 0; i < l->size; i++) {
+		c->elem[i] = termClone(l->elem[i]);
+		termSetShared(c->elem[i], l->elem[i]->shared);
+	}
+
+	return c;
+}
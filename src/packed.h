@@ -0,0 +1,57 @@
+// vim:noet:ts=3
+
+/* Declarations for packed.c
+
+	Copyright (C) 2004-8 Kostas Chatzikokolakis
+	This file is part of LCI
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details. */
+
+#ifndef PACKED_H
+#define PACKED_H
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "grammar.h"
+
+#define LIST_MAXSIZE		(1 << 24)		// elements of the largest list built by a builtin
+
+// The encodings a packed list stands for
+typedef enum {
+	LS_LIST,									// \c.\n.c A (c B ... n), see Cons
+	LS_STRING								// \z.z A (\z.z B ... Empty), see ToString
+} LIST_KIND;
+
+// Lists kept as arrays of their elements (TM_LIST terms), built by builtins
+// (see prim.c). A list stands for its encoding, which is unfolded one element
+// at a time when it is applied, so it costs no more than the nested terms; but
+// its length, elements and slices are found in constant time and it is printed
+// in linear time. Lists are allocated with arenaAllocBig like BIGNUMs and are
+// never modified, slices share the array of elements. The elements are closed
+// terms marked as permanently shared (see termSetShared), so that they are
+// never modified or freed before the arena. A list is never empty, the empty
+// list is 0 (Nil).
+typedef struct tag_list {
+	int size;
+	LIST_KIND kind;
+	char nf;									// all elements are known to be in normal form
+	TERM **elem;
+} LIST;
+
+
+LIST *listNew(int size, LIST_KIND kind);
+LIST *listSlice(LIST *l, int from, int size);
+LIST *listClone(LIST *l);
+
+
+#endif
@@ -0,0 +1,454 @@
+// vim:noet:ts=3
+
+/* Builtins computing the applications of some aliases
+
+	Copyright (C) 2004-8 Kostas Chatzikokolakis
+	This file is part of LCI
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details. */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "prim.h"
+#include "termproc.h"
+#include "number.h"
+#include "packed.h"
+
+
+// Arithmetic
+//
+// Each operation works on ints, and on BIGNUMs when the arguments or the result
+// do not fit in an int (the int version returns 0 then).
+
+static int numPlus(int a, int b, int *r) {
+	if(b > INT_MAX - a) return 0;
+	*r = a + b;
+	return 1;
+}
+
+static int numTimes(int a, int b, int *r) {
+	if(a != 0 && b > INT_MAX / a) return 0;
+	*r = a * b;
+	return 1;
+}
+
+static int numMonus(int a, int b, int *r) {
+	*r = a > b ? a - b : 0;
+	return 1;
+}
+
+static int numDivide(int a, int b, int *r) {
+	if(b == 0) return 0;
+	*r = a / b;
+	return 1;
+}
+
+static int numModulus(int a, int b, int *r) {
+	if(b == 0) return 0;
+	*r = a % b;
+	return 1;
+}
+
+static int numPower(int a, int b, int *r) {
+	long long v;
+
+	if(a <= 1) {
+		*r = b == 0 ? 1 : a;
+		return 1;
+	}
+
+	for(v = 1; b > 0; b--)
+		if((v *= a) > INT_MAX) return 0;
+	*r = v;
+	return 1;
+}
+
+// numeral
+//
+// Returns a new numeral, big if it is not NULL, otherwise n
+
+static TERM *numeral(int n, BIGNUM *big) {
+	TERM *t = termNew();
+
+	termSetNumeral(t, n, big);
+	return t;
+}
+
+// boolean
+//
+// Returns True (\f.\x.f) or False (\f.\x.x, which is also 0)
+
+static TERM *boolean(int b) {
+	TERM *t = termChurchNum(0);
+
+	if(b)
+		t->rterm->rterm->name = t->lterm->name;
+	return t;
+}
+
+// numApply
+//
+// Applies op (or bigOp) to the numerals args[0] and args[1]
+
+static TERM *numApply(TERM **args, int (*op)(int a, int b, int *r),
+							 BIGNUM *(*bigOp)(BIGNUM *a, BIGNUM *b)) {
+	BIGNUM *bigA, *bigB, *res = NULL;
+	int a, b, v = 0;
+
+	if(!termNumber(args[0], &a, &bigA) || !termNumber(args[1], &b, &bigB))
+		return NULL;
+
+	if((!bigA && !bigB && op(a, b, &v)) ||
+		(res = bigOp(bigA ? bigA : bigFromInt(a), bigB ? bigB : bigFromInt(b))))
+		return numeral(v, res);
+
+	return NULL;
+}
+
+// numCompare
+//
+// Compares the numerals args[0] and args[1], returns -1, 0 or 1 in *cmp
+
+static int numCompare(TERM **args, int *cmp) {
+	BIGNUM *bigA, *bigB;
+	int a, b;
+
+	if(!termNumber(args[0], &a, &bigA) || !termNumber(args[1], &b, &bigB))
+		return 0;
+
+	*cmp = !bigA && !bigB
+		? (a > b) - (a < b)
+		: bigCmp(bigA ? bigA : bigFromInt(a), bigB ? bigB : bigFromInt(b));
+	return 1;
+}
+
+static TERM *primPlus(TERM **args)		{ return numApply(args, numPlus, bigAdd); }
+static TERM *primTimes(TERM **args)		{ return numApply(args, numTimes, bigMul); }
+static TERM *primMonus(TERM **args)		{ return numApply(args, numMonus, bigMonus); }
+static TERM *primDivide(TERM **args)	{ return numApply(args, numDivide, bigDivide); }
+static TERM *primModulus(TERM **args)	{ return numApply(args, numModulus, bigModulus); }
+static TERM *primPower(TERM **args)		{ return numApply(args, numPower, bigPower); }
+
+static TERM *primIncrement(TERM **args) {
+	BIGNUM *big;
+	int n;
+
+	if(!termNumber(args[0], &n, &big))
+		return NULL;
+
+	return n < INT_MAX && !big
+		? numeral(n + 1, NULL)
+		: numeral(0, bigAdd(big ? big : bigFromInt(n), bigFromInt(1)));
+}
+
+static TERM *primDecrement(TERM **args) {
+	BIGNUM *big;
+	int n;
+
+	if(!termNumber(args[0], &n, &big))
+		return NULL;
+
+	return big
+		? numeral(0, bigMonus(big, bigFromInt(1)))
+		: numeral(n > 0 ? n - 1 : 0, NULL);
+}
+
+static TERM *primIsZero(TERM **args) {
+	BIGNUM *big;
+	int n;
+
+	return termNumber(args[0], &n, &big) ? boolean(!big && n == 0) : NULL;
+}
+
+// Comparisons
+
+static TERM *primEQ(TERM **args) { int c; return numCompare(args, &c) ? boolean(c == 0) : NULL; }
+static TERM *primNE(TERM **args) { int c; return numCompare(args, &c) ? boolean(c != 0) : NULL; }
+static TERM *primLT(TERM **args) { int c; return numCompare(args, &c) ? boolean(c < 0) : NULL; }
+static TERM *primLE(TERM **args) { int c; return numCompare(args, &c) ? boolean(c <= 0) : NULL; }
+static TERM *primGT(TERM **args) { int c; return numCompare(args, &c) ? boolean(c > 0) : NULL; }
+static TERM *primGE(TERM **args) { int c; return numCompare(args, &c) ? boolean(c >= 0) : NULL; }
+
+// primNumeral
+//
+// Computes the application of numeral m without expanding it (m is applied to
+// its arguments f^m times): m a is a^m, and m f a is a+m if f is bound to
+// Increment, or a-m if it is bound to Decrement (as in the body of Monus). f is
+// the builtin bound to the first argument, -1 if m is applied to a alone.
+// Returns NULL if the application has no such shortcut. 0 a (which is also
+// False a) and 1 a (also I a) are left to beta reduction, which is as fast, and
+// gives I or a instead of numeral 1, which needs an eta reduction when applied.
+
+TERM *primNumeral(TERM *m, int f, TERM *a) {
+	TERM *args[2] = { a, m };
+	BIGNUM *big;
+	int n;
+
+	return
+		f == -1 ? (termNumber(m, &n, &big) && (big || n > 1) ? primPower(args) : NULL) :
+		prims[f].fn == primIncrement ? primPlus(args) :
+		prims[f].fn == primDecrement ? primMonus(args) :
+		NULL;
+}
+
+// list
+//
+// Returns a new list l (Nil if l is NULL)
+
+static TERM *list(LIST *l) {
+	TERM *t = termNew();
+
+	termSetList(t, l);
+	return t;
+}
+
+// element
+//
+// Makes the closed term t an element of a list (see packed.h)
+
+static void element(TERM *t) {
+	termSetShared(t, t->shared == 2 || t->type == TM_NUM ? 2 : 1);
+}
+
+// listShape
+//
+// Returns the number of elements of t if it is a list, \c.\n.c A (c B ... n)
+// (or \c.c A, the eta-reduced list of one element), otherwise -1. Its elements
+// are stored in elem, if it is not NULL.
+
+static int listShape(TERM *t, TERM **elem) {
+	TERM *r;
+	char *c, *n;
+	int len;
+
+	if(t->type == TM_NUM)								// Nil is 0
+		return !t->big && t->num == 0 ? 0 : -1;
+	if(t->type != TM_ABSTR)
+		return -1;
+
+	c = t->lterm->name;
+	r = t->rterm;
+	if(r->type == TM_APPL) {
+		if(r->lterm->type != TM_VAR || r->lterm->name != c || termIsFreeVar(r->rterm, c))
+			return -1;
+		if(elem)
+			elem[0] = r->rterm;
+		return 1;
+	}
+	if(r->type != TM_ABSTR || (n = r->lterm->name) == c)
+		return -1;
+
+	for(len = 0, r = r->rterm; r->type == TM_APPL; r = r->rterm, len++) {
+		if(r->lterm->type != TM_APPL ||
+			r->lterm->lterm->type != TM_VAR || r->lterm->lterm->name != c ||
+			termIsFreeVar(r->lterm->rterm, c) || termIsFreeVar(r->lterm->rterm, n))
+			return -1;
+		if(elem)
+			elem[len] = r->lterm->rterm;
+	}
+
+	return r->type == TM_VAR && r->name == n ? len : -1;
+}
+
+// listArg
+//
+// Stores in *l the list t stands for (NULL for Nil) and returns 1, if t is a
+// packed list or has the shape of a list (see listShape) with closed elements,
+// then it is packed. Otherwise returns 0.
+
+static int listArg(TERM *t, LIST **l) {
+	TERM *e;
+	int n, i;
+
+	if(t->type == TM_LIST) {
+		*l = t->list;
+		return t->list->kind == LS_LIST;
+	}
+
+	if((n = listShape(t, NULL)) <= 0) {
+		*l = NULL;
+		return n == 0;
+	}
+
+	if(!(*l = listNew(n, LS_LIST)))
+		return 0;
+	listShape(t, (*l)->elem);
+
+	for(i = 0; i < n; i++) {
+		e = (*l)->elem[i];
+		if(!e->closed)
+			termSetClosedFlag(e);					// the flag may be stale
+		if(!e->closed)
+			return 0;
+		if(!(e->shared == 2 || e->type == TM_NUM || (e->type == TM_LIST && e->list->nf)))
+			(*l)->nf = 0;
+	}
+
+	for(i = 0; i < n; i++)
+		element((*l)->elem[i]);
+	return 1;
+}
+
+static TERM *primLength(TERM **args) {
+	TERM *t = args[0];
+	int n = t->type != TM_LIST ? listShape(t, NULL) :
+		t->list->kind == LS_LIST ? t->list->size : -1;
+
+	return n >= 0 ? numeral(n, NULL) : NULL;
+}
+
+static TERM *primAppend(TERM **args) {
+	LIST *a, *b, *r;
+
+	if(!listArg(args[0], &a) || !listArg(args[1], &b))
+		return NULL;
+	if(!a || !b)
+		return list(a ? a : b);
+	if(a->size > LIST_MAXSIZE - b->size || !(r = listNew(a->size + b->size, LS_LIST)))
+		return NULL;
+
+	memcpy(r->elem, a->elem, a->size * sizeof(TERM*));
+	memcpy(r->elem + a->size, b->elem, b->size * sizeof(TERM*));
+	r->nf = a->nf && b->nf;
+	return list(r);
+}
+
+static TERM *primReverse(TERM **args) {
+	LIST *a, *r;
+	int i;
+
+	if(!listArg(args[0], &a))
+		return NULL;
+	if(!a)
+		return list(NULL);
+
+	if(!(r = listNew(a->size, LS_LIST)))
+		return NULL;
+	for(i = 0; i < a->size; i++)
+		r->elem[i] = a->elem[a->size - 1 - i];
+	r->nf = a->nf;
+	return list(r);
+}
+
+// primIndex
+//
+// l !! n is the list of the n-th element of l (1 is the first one, and so is
+// 0), or Nil if there is none
+
+static TERM *primIndex(TERM **args) {
+	BIGNUM *big;
+	LIST *l;
+	int n;
+
+	if(!listArg(args[0], &l) || !termNumber(args[1], &n, &big))
+		return NULL;
+	if(n > 0) n--;
+
+	return list(l && !big && n < l->size ? listSlice(l, n, 1) : NULL);
+}
+
+// primRange
+//
+// n..m is the list of the numbers from n up to m, or down to m if m < n. The
+// numerals are charged together with the list (see arenaRoom).
+
+static TERM *primRange(TERM **args) {
+	BIGNUM *bigA, *bigB;
+	long long size;
+	int a, b, i;
+	LIST *l;
+
+	if(!termNumber(args[0], &a, &bigA) || !termNumber(args[1], &b, &bigB) ||
+		bigA || bigB ||
+		(size = (a < b ? (long long)b - a : (long long)a - b) + 1) > LIST_MAXSIZE ||
+		!arenaRoom(size * sizeof(TERM)) || !(l = listNew(size, LS_LIST)))
+		return NULL;
+
+	for(i = 0; i < size; i++) {
+		l->elem[i] = numeral(a < b ? a + i : a - i, NULL);
+		l->elem[i]->closed = 1;
+		element(l->elem[i]);
+	}
+	return list(l);
+}
+
+// primToString
+//
+// Returns the string (nested pairs ending with Empty) of the elements of a
+// non-empty list
+
+static TERM *primToString(TERM **args) {
+	LIST *l;
+
+	if(!listArg(args[0], &l) || !l)
+		return NULL;
+
+	l = listSlice(l, 0, l->size);
+	l->kind = LS_STRING;
+	return list(l);
+}
+
+// The builtins that can be bound to aliases. Each one computes the alias of
+// the same name in .lcirc.
+
+PRIM prims[] = {
+	{ "Plus",		"ss",	primPlus },
+	{ "Times",		"ss",	primTimes },
+	{ "Monus",		"ss",	primMonus },
+	{ "Divide",		"ss",	primDivide },
+	{ "Modulus",	"ss",	primModulus },
+	{ "Power",		"ss",	primPower },
+	{ "Increment",	"s",	primIncrement },
+	{ "Decrement",	"s",	primDecrement },
+	{ "IsZero",		"s",	primIsZero },
+	{ "EQ",			"ss",	primEQ },
+	{ "NE",			"ss",	primNE },
+	{ "LT",			"ss",	primLT },
+	{ "LE",			"ss",	primLE },
+	{ "GT",			"ss",	primGT },
+	{ "GE",			"ss",	primGE },
+	{ "Length",		"l",	primLength },
+	{ "Append",		"ll",	primAppend },
+	{ "Reverse",	"l",	primReverse },
+	{ "Index",		"ls",	primIndex },
+	{ "Range",		"ss",	primRange },
+	{ "ToString",	"l",	primToString },
+	{ NULL, NULL, NULL }
+};
+
+// primFind
+//
+// Returns the position in prims of builtin id, -1 if there is none
+
+int primFind(char *id) {
+	int i;
+
+	for(i = 0; prims[i].id; i++)
+		if(strcmp(prims[i].id, id) == 0)
+			return i;
+
+	return -1;
+}
+
+// primArity
+//
+// Returns the number of arguments of builtin prim
+
+int primArity(int prim) {
+	return strlen(prims[prim].args);
+}
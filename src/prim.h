@@ -0,0 +1,52 @@
+// vim:noet:ts=3
+
+/* Declarations for prim.c
+
+	Copyright (C) 2004-8 Kostas Chatzikokolakis
+	This file is part of LCI
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details. */
+
+#ifndef PRIM_H
+#define PRIM_H
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "grammar.h"
+
+#define PRIM_MAXARGS		2
+
+// Builtins are C functions that compute the application of an alias, once it
+// is bound to them with Prim. A builtin gets the arguments of the call (strict
+// ones are numerals or lists in normal form, they are not reduced to become so)
+// and returns the term the call reduces to, or NULL if it cannot handle these
+// arguments, then the alias is expanded as usual. The result must be a new
+// term, it may contain copies of the arguments but not the arguments
+// themselves.
+typedef TERM *(*PRIM_FN)(TERM **args);
+
+typedef struct {
+	char *id;
+	char *args;								// one letter per argument, s(trict) or l(azy)
+	PRIM_FN fn;
+} PRIM;
+
+extern PRIM prims[];
+
+
+int primFind(char *id);
+int primArity(int prim);
+TERM *primNumeral(TERM *m, int f, TERM *a);
+
+
+#endif
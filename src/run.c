@@ -38,10 +38,14 @@
 #include "parser.h"
 #include "termproc.h"
 #include "decllist.h"
+#include "engine.h"
+#include "dbterm.h"
+#include "prim.h"
 
 
 int trace;
-int options[OPTNO] = {0, 0, 0, 0, 1};
+int options[OPTNO] = {0, 0, 0, 0, 1, 0, 0, STR_NORMAL};
+int execDepth = 0;			// execTerm is re-entered by queries of consulted files
 
 #ifndef NDEBUG
 extern int freeNo;
@@ -52,11 +56,19 @@ int execTerm(TERM *t) {
 	int retval = 0;
 	long stime = clock();
 	char c;
+	ENGINE *eng = engines[getOption(OPT_ENGINE)];
+	void *state;
 
 	trace = getOption(OPT_TRACE);
+	execDepth++;
+
+	// the memory limit (in MB) is checked whenever the query arena grows
+	memLimit = (size_t)getOption(OPT_MAXMEM) << 20;
+	memExceeded = 0;
 
 	// remove operators before executing
 	termRemoveOper(t);
+	termMarkStrategy(t, NULL);
 
 	// calculate closed flag for all sub-terms (must be done after termRemoveOper)
 	termSetClosedFlag(t);
@@ -69,9 +81,14 @@ int execTerm(TERM *t) {
 		// during execution, SIGINT signals enable trace
 		signal(SIGINT, sigHandler);
 
-		// perform all reductions
+		// the selected engine performs the reductions
+		queryNo++;
+		state = eng->start(t);
+
+		// perform all reductions (step returns how many it has performed, an
+		// engine that normalizes in one go reports all of them at once)
 		do {
-			redno++;
+			redno += res;
 
 			if(trace) {
 #ifdef USE_READLINE
@@ -92,7 +109,7 @@ int execTerm(TERM *t) {
 				ioctl(0, TCSETA, &tio);						// set new settings
 #endif
 
-				termPrint(t, 1);
+				termPrint(eng->term(state), 1);
 				printf("  ?> ");
 				fflush(stdout);
 				do {
@@ -129,17 +146,29 @@ int execTerm(TERM *t) {
 				if(c == 'a') break;
 
 			} else if(showExec) {
-				termPrint(t, 1);
+				termPrint(eng->term(state), 1);
 				printf("\n");
 			}
-		} while((res = termConv(t)) == 1);
+		} while(!memExceeded && (res = eng->step(state)) > 0);
+
+		// if the query used too much memory it is abandoned, the partial term is
+		// reclaimed below together with everything else the query allocated. The
+		// size reported includes the memory of the engine (see arenaCharge).
+		if(memExceeded) {
+			printf("Error: memory limit of %d MB exceeded after %d reductions (%ld live terms, %lu KB in use).\n",
+				getOption(OPT_MAXMEM), redno, arenas[AR_QUERY].liveNo,
+				(unsigned long)(arenas[AR_QUERY].size >> 10));
+			res = -1;
+		}
 
 		// if execution is finished, print result
 		if(res == 0) {
 			printf("\n");
-			termPrint(t, 1);
-			printf("\n(%d reductions, %.2fs CPU)\n",
-				redno, (double)(clock()-stime) / CLOCKS_PER_SEC);
+			termPrint(eng->term(state), 1);
+			printf("\n(%d reductions", redno);
+			if(eng->stats)
+				eng->stats(state);
+			printf(", %.2fs CPU)\n", (double)(clock()-stime) / CLOCKS_PER_SEC);
 #ifndef NDEBUG
 			printf("%d termIsFree's\n", freeNo);
 #endif
@@ -163,9 +192,15 @@ int execTerm(TERM *t) {
 		break;
 	}
 
-	// free memory
-	termFree(t);
-	termGC();					// call terms garbageCollector
+	// free memory. The whole query arena can be reclaimed at once, but only when
+	// the outermost query finishes (the term of an enclosing Consult is still in use).
+	// Replaced declarations can be freed at the same point, no term shares them anymore.
+	if(--execDepth == 0) {
+		termGC();
+		dbGC();
+		declReclaim();
+	} else
+		termFree(t);
 
 	return retval;
 }
@@ -230,6 +265,83 @@ int execSystemCmd(TERM *t) {
 		// add the operator's declaration
 		addOper(strdup(oper), prec, ass);
 
+	} else if(strcmp(t->name, "DefStrategy") == 0) {
+		// DefStrategy alias (strict|lazy|default)
+		//
+		// Declares how the calls of an alias are evaluated (see termMarkStrategy)
+		DECL *decl;
+		DECL_STRATEGY strategy;
+
+		if(parno != 2) return -1;
+
+		// param 1: alias
+		par = *--sp;
+		if(par->type != TM_ALIAS) return -1;
+		if(!(decl = getDecl(par->name))) {
+			printf("Error: Alias %s is not declared.\n", par->name);
+			return 0;
+		}
+
+		// param 2: strategy
+		par = *--sp;
+		if(par->type != TM_VAR) return -1;
+		if(strcmp(par->name, "strict") == 0)
+			strategy = DS_STRICT;
+		else if(strcmp(par->name, "lazy") == 0)
+			strategy = DS_LAZY;
+		else if(strcmp(par->name, "default") == 0)
+			strategy = DS_DEFAULT;
+		else
+			return -1;
+
+		declSetStrategy(decl, strategy);
+
+	} else if(strcmp(t->name, "Prim") == 0) {
+		// Prim [alias [builtin|off]]
+		//
+		// Binds an alias to a builtin (see termPrim), the one with the same name
+		// if none is given. Without parameters lists the builtins.
+		DECL *decl;
+		char *id;
+		int i, j;
+
+		if(parno == 0) {
+			for(i = 0; prims[i].id; i++) {
+				printf("%-12s%d argument%s:", prims[i].id, primArity(i), primArity(i) > 1 ? "s" : "");
+				for(j = 0; prims[i].args[j]; j++)
+					printf("%s %s", j ? "," : "", prims[i].args[j] == 's' ? "strict" : "lazy");
+				putchar('\n');
+			}
+			return 0;
+		}
+		if(parno > 2) return -1;
+
+		// param 1: alias
+		par = *--sp;
+		if(par->type != TM_ALIAS) return -1;
+		if(!(decl = getDecl(par->name))) {
+			printf("Error: Alias %s is not declared.\n", par->name);
+			return 0;
+		}
+		id = par->name;
+
+		// param 2: builtin
+		if(parno == 2) {
+			par = *--sp;
+			if(par->type == TM_VAR && strcmp(par->name, "off") == 0) {
+				decl->prim = -1;
+				return 0;
+			}
+			if(par->type != TM_ALIAS) return -1;
+			id = par->name;
+		}
+
+		if((i = primFind(id)) == -1) {
+			printf("Error: There is no builtin %s.\n", id);
+			return 0;
+		}
+		decl->prim = i;
+
 	} else if(strcmp(t->name, "ShowAlias") == 0) {
 		// ShowAlias
 		//
@@ -310,11 +422,37 @@ int execSystemCmd(TERM *t) {
 			opt = OPT_SHOWEXEC;
 		else if(strcmp(par->name, "readable") == 0)
 			opt = OPT_READABLE;
+		else if(strcmp(par->name, "engine") == 0)
+			opt = OPT_ENGINE;
+		else if(strcmp(par->name, "maxmem") == 0)
+			opt = OPT_MAXMEM;
+		else if(strcmp(par->name, "strategy") == 0)
+			opt = OPT_STRATEGY;
 		else
 			return -1;
 
 		par = *--sp;
-		if(strcmp(par->name, "on") == 0)
+		if(opt == OPT_ENGINE) {
+			if(par->type != TM_VAR || (value = getEngine(par->name)) == -1)
+				return -1;
+		} else if(opt == OPT_STRATEGY) {
+			if(par->type != TM_VAR) return -1;
+			if(strcmp(par->name, "normal") == 0)
+				value = STR_NORMAL;
+			else if(strcmp(par->name, "value") == 0)
+				value = STR_VALUE;
+			else if(strcmp(par->name, "need") == 0)
+				value = STR_NEED;
+			else
+				return -1;
+		} else if(opt == OPT_MAXMEM) {
+			// limit in MB, off for no limit
+			if((value = termNatural(par)) == -1) {
+				if(par->type != TM_VAR || strcmp(par->name, "off") != 0)
+					return -1;
+				value = 0;
+			}
+		} else if(strcmp(par->name, "on") == 0)
 			value = 1;
 		else if(strcmp(par->name, "off") == 0)
 			value = 0;
@@ -326,16 +464,26 @@ int execSystemCmd(TERM *t) {
 		// Help
 		//
 		// Prints help message
+		int i;
+
 		printf("\nlci - A lambda calculus interpreter\n\n");
 		printf("Type a lambda term to compute its normal form\n");
 		printf("or enter one of the following system commands:\n\n");
 
 		printf("FixedPoint\t\tRemoves recursion using fixed point comb. Y\n");
 		printf("DefOp name prec ass\tDefines an operator\n");
+		printf("DefStrategy name s\tEvaluates the calls of an alias strict, lazy\n\t\t\tor default\n");
+		printf("Prim [name [b|off]]\tComputes the calls of an alias with builtin b\n\t\t\t(tree engine), or lists the builtins\n");
 		printf("ShowAlias [name]\tList the specified or all stored aliases\n");
 		printf("Print term\t\tDisplays the term\n");
 		printf("Consult file\t\tReads and interprets the specified file\n");
 		printf("Set option (on|off)\tChanges one of the following options:\n\t\t\ttrace, showexec, showpar, greeklambda, readable\n");
+		printf("Set engine name\t\tSelects the reduction engine, one of:\n\t\t\t");
+		for(i = 0; engines[i]; i++)
+			printf("%s%s", i ? ", " : "", engines[i]->name);
+		printf("\n");
+		printf("Set strategy name\tSelects the evaluation strategy, normal, value\n\t\t\t(tree and debruijn engines) or need (call-by-need,\n\t\t\ttree engine only)\n");
+		printf("Set maxmem (N|off)\tLimits the memory of a query to N MB\n");
 		printf("Help\t\t\tDisplays this message\n");
 		printf("Quit\t\t\tQuit the program (same as Ctrl-D)\n");
 
@@ -402,6 +550,13 @@ int getOption(OPT opt) {
 	return options[opt]; 
 }
 
+// setOption
+//
+// Changes the value of option opt
+void setOption(OPT opt, int value) {
+	options[opt] = value;
+}
+
 // sigHandler
 //
 // Handles SIGINT signal during execution. It enables the trace functionality.
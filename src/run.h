@@ -22,8 +22,13 @@
 
 #include "grammar.h"
 
-#define OPTNO	5
-typedef enum {OPT_TRACE = 0, OPT_SHOWPAR, OPT_GREEKLAMBDA, OPT_SHOWEXEC, OPT_READABLE} OPT;
+#define OPTNO	8
+typedef enum {OPT_TRACE = 0, OPT_SHOWPAR, OPT_GREEKLAMBDA, OPT_SHOWEXEC, OPT_READABLE, OPT_ENGINE, OPT_MAXMEM, OPT_STRATEGY} OPT;
+
+// evaluation strategies (values of OPT_STRATEGY)
+typedef enum {STR_NORMAL = 0, STR_VALUE, STR_NEED} STRATEGY;
+
+extern int trace;						// set by SIGINT during execution
 
 
 void progInterpret(COMMAND *cmdList);
@@ -32,6 +37,7 @@ void progFree(COMMAND *cmdList);
 int execSystemCmd(TERM *t);
 int consultFile(char *fname);
 int getOption(OPT opt);
+void setOption(OPT opt, int value);
 
 void sigHandler(int sig);
 
@@ -0,0 +1,464 @@
+// vim:noet:ts=3
+
+/* Combinator graph reduction
+
+	Copyright (C) 2004-8 Kostas Chatzikokolakis
+	This file is part of LCI
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details. */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include "ski.h"
+#include "dbterm.h"
+#include "decllist.h"
+#include "termalloc.h"
+#include "run.h"
+
+
+// The term is compiled to combinators by bracket abstraction, with Turner's
+// rules (x is the variable being abstracted):
+//		[x] x			= I
+//		[x] M			= K M							x not free in M
+//		[x] M x		= M							x not free in M
+//		[x] M N		= B M ([x] N)				x not free in M
+//		[x] M N		= C ([x] M) N				x not free in N
+//		[x] M N		= S ([x] M) ([x] N)
+// Abstractions are compiled innermost first, so the result has no variables at
+// all and is reduced as a graph with the rules
+//		I x = x,  K x y = x,  S f g x = f x (g x),  B f g x = f (g x),  C f g x = f x g
+// where the root of the redex is overwritten with its result (or an indirection
+// to it), so shared arguments are reduced once. Declarations are compiled once
+// per query (kept in the DECL, see queryNo) and reduced in place too.
+//
+// While compiling, bound variables are identified by the level of their
+// abstraction (counted from the root), and each node keeps the largest level
+// it contains. Inside the body of an abstraction at level d no variable has a
+// larger level, so the variable of the abstraction is free in a node iff the
+// node's level is d.
+//
+// The normal form is read back like in the nbe engine: a term in weak head
+// normal form is either a variable applied to arguments, which are read back in
+// turn, or a combinator applied to fewer arguments than it needs, which is a
+// function. It is applied to a fresh variable (identified by its level) and the
+// result is read back under one more abstraction. The compiled code does not
+// keep the names of bound variables, the root of each abstraction's code
+// remembers it as a hint.
+//
+// The whole normal form is computed in one step, like in the nbe engine.
+
+typedef enum { SN_APP, SN_COMB, SN_VAR, SN_FREE, SN_ALIAS, SN_IND } SNODE_KIND;
+typedef enum { SC_I, SC_K, SC_S, SC_B, SC_C } SCOMB;
+
+// l, r are the function and argument of applications, l the target of
+// indirections. level is the level of variables and, while compiling, the
+// largest level in the node (-1 if none). name is the name of free variables
+// and aliases, and the name of the bound variable for the code of abstractions.
+typedef struct tag_snode {
+	SNODE_KIND kind;
+	SCOMB comb;
+	int level;
+	char *name;
+	struct tag_snode *l, *r;
+} SNODE;
+
+typedef struct {
+	SNODE *node;							// the compiled query
+	TERM *t;
+	DBTERM res;								// its normal form, once computed
+	TERM *shown;							// last term returned by skiTerm
+} SSTATE;
+
+static int reductions, combinators;
+static int traced;						// trace was on when the step started
+
+static SNODE **stack = NULL;			// spine of the term being reduced
+static int sp, stackSize = 0;
+static DBTERM *chain = NULL;			// see readback
+static int chainNo, chainSize = 0;
+
+static const int arity[] = { 1, 2, 3, 3, 3 };
+
+
+// newNode
+//
+// Returns a new node of the given kind
+
+static SNODE *newNode(SNODE_KIND kind, SNODE *l, SNODE *r) {
+	SNODE *n = arenaAlloc(sizeof(SNODE));
+
+	n->kind = kind;
+	n->level = -1;
+	n->name = NULL;
+	n->l = l;
+	n->r = r;
+	return n;
+}
+
+// newAppl
+//
+// Returns the application of l to r
+
+static SNODE *newAppl(SNODE *l, SNODE *r) {
+	SNODE *n = newNode(SN_APP, l, r);
+
+	n->level = l->level > r->level ? l->level : r->level;
+	return n;
+}
+
+// newComb
+//
+// Returns combinator c applied to l and r (those that are not NULL)
+
+static SNODE *newComb(SCOMB c, SNODE *l, SNODE *r) {
+	SNODE *n = newNode(SN_COMB, NULL, NULL);
+
+	n->comb = c;
+	combinators++;
+
+	if(l)
+		n = newAppl(n, l);
+	if(r)
+		n = newAppl(n, r);
+	return n;
+}
+
+// abstract
+//
+// Returns [x] m, where x is the variable of level d. The application nodes of m
+// are not used anymore.
+
+static SNODE *abstract(SNODE *m, int d) {
+	SNODE *p, *q;
+
+	if(m->level < d)
+		return newComb(SC_K, m, NULL);
+
+	if(m->kind == SN_VAR)
+		return newComb(SC_I, NULL, NULL);
+
+	assert(m->kind == SN_APP);
+	p = m->l;
+	q = m->r;
+	arenaFree(m, sizeof(SNODE));
+
+	if(p->level < d)
+		return q->kind == SN_VAR
+			? p
+			: newComb(SC_B, p, abstract(q, d));
+
+	if(q->level < d)
+		return newComb(SC_C, abstract(p, d), q);
+
+	p = abstract(p, d);
+	return newComb(SC_S, p, abstract(q, d));
+}
+
+// compile
+//
+// Returns the code of t, placed under depth abstractions
+
+static SNODE *compile(DBTERM t, int depth) {
+	SNODE *n, *l;
+
+	switch(DB_TYPE(t)) {
+	 case DB_VAR:
+		n = newNode(SN_VAR, NULL, NULL);
+		n->level = depth - 1 - DB_INDEX(t);
+		return n;
+
+	 case DB_FREE:
+	 case DB_ALIAS:
+		n = newNode(DB_TYPE(t) == DB_FREE ? SN_FREE : SN_ALIAS, NULL, NULL);
+		n->name = DB_NAME(t);
+		return n;
+
+	 case DB_APPL:
+		l = compile(DB_L(t), depth);
+		return newAppl(l, compile(DB_R(t), depth));
+
+	 case DB_ABSTR:
+		n = abstract(compile(DB_R(t), depth + 1), depth);
+
+		// keep the name as a hint (variables, free ones and aliases have no room)
+		if(!n->name && (n->kind == SN_APP || n->kind == SN_COMB))
+			n->name = DB_NAME(t);
+		return n;
+
+	 default:
+		assert(0);
+		return NULL;
+	}
+}
+
+// aliasCode
+//
+// Returns the code of the declaration with the given id, compiled once per query
+
+static SNODE *aliasCode(char *id) {
+	DECL *decl = getDecl(id);
+	DBTERM t;
+
+	if(!decl) {
+		printf("Error: Alias %s is not declared.\n", id);
+		return NULL;
+	}
+
+	if(decl->valueQuery != queryNo) {
+		t = dbFromDecl(id);
+		decl->value = compile(t, 0);
+		decl->valueQuery = queryNo;
+	}
+	return decl->value;
+}
+
+// push
+//
+// Pushes a node of the spine
+
+static void push(SNODE *n) {
+	if(sp == stackSize &&
+		!(stack = realloc(stack, (stackSize = stackSize ? 2 * stackSize : 1024) * sizeof(SNODE*)))) {
+		fprintf(stderr, "Error: out of memory.\n");
+		exit(1);
+	}
+	stack[sp++] = n;
+}
+
+// whnf
+//
+// Reduces n to weak head normal form and returns it (following indirections),
+// or NULL on error. The arguments of the head are left in stack above base.
+
+static SNODE *whnf(SNODE *n, int base) {
+	SNODE *h, *root, *a1, *a2, *a3;
+	int a;
+
+	sp = base;
+	h = n;
+
+	for(;;) {
+		// the normal form is computed in one step, so a SIGINT (which enables
+		// trace) cannot stop the query between steps
+		if(trace && !traced) {
+			printf("Error: interrupted after %d reductions.\n", reductions);
+			return NULL;
+		}
+		if(memExceeded)
+			return NULL;
+
+		// unwind the spine
+		for(;;) {
+			while(h->kind == SN_IND)
+				h = h->l;
+			if(h->kind != SN_APP)
+				break;
+			push(h);
+			h = h->l;
+		}
+
+		if(h->kind == SN_ALIAS) {
+			if(!(root = aliasCode(h->name)))
+				return NULL;
+			h->kind = SN_IND;
+			h->l = root;
+			continue;
+		}
+
+		if(h->kind != SN_COMB || sp - base < (a = arity[h->comb]))
+			break;
+
+		// the redex is the a-th application of the spine
+		root = stack[sp - a];
+		a1 = stack[sp - 1]->r;
+		a2 = a > 1 ? stack[sp - 2]->r : NULL;
+		a3 = a > 2 ? stack[sp - 3]->r : NULL;
+		sp -= a;
+		reductions++;
+
+		switch(h->comb) {
+		 case SC_I:
+		 case SC_K:
+			root->kind = SN_IND;
+			root->l = a1;
+			break;
+
+		 case SC_S:
+			root->l = newAppl(a1, a3);
+			root->r = newAppl(a2, a3);
+			break;
+
+		 case SC_B:
+			root->l = a1;
+			root->r = newAppl(a2, a3);
+			break;
+
+		 case SC_C:
+			root->l = newAppl(a1, a3);
+			root->r = a2;
+			break;
+		}
+		h = root;
+	}
+
+	// the spine is in weak head normal form, find its root
+	n = sp > base ? stack[base] : h;
+	while(n->kind == SN_IND)
+		n = n->l;
+	return n;
+}
+
+// readback
+//
+// Returns the normal form of n, placed under depth abstractions, or DB_NULL on
+// error. Eta-reductions are performed as the abstractions are built.
+//
+// The last argument of a variable is read back in the same loop, so long chains
+// (f (f (f ... x))) like numerals do not nest (see quote in nbe.c).
+
+static DBTERM readback(SNODE *n, int depth) {
+	int base = chainNo, i, argBase, argNo;
+	DBTERM t, l, body, m;
+	SNODE *h, *x;
+
+	for(;;) {
+		argBase = sp;
+		if(!(n = whnf(n, argBase)))
+			return DB_NULL;
+		argNo = sp - argBase;
+		for(h = argNo ? stack[sp - 1]->l : n; h->kind == SN_IND; h = h->l)
+			;
+
+		if(h->kind == SN_COMB) {
+			// a function, applied to a fresh variable
+			sp = argBase;
+			x = newNode(SN_VAR, NULL, NULL);
+			x->level = depth;
+			if(!(body = readback(newNode(SN_APP, n, x), depth + 1)))
+				return DB_NULL;
+
+			// \.M 0 -> M  if 0 not free in M
+			if(DB_TYPE(body) == DB_APPL &&
+				DB_TYPE(DB_R(body)) == DB_VAR &&
+				DB_INDEX(DB_R(body)) == 0 &&
+				!dbIsFree(DB_L(body), 0)) {
+
+				m = DB_L(body);
+				dbFreeNode(DB_R(body));
+				dbFreeNode(body);
+				dbShift(m, -1, 0);
+				t = m;
+			} else
+				t = dbNewAbstr(n->name, body);
+			break;
+		}
+
+		// a variable applied to argNo arguments, the last one is read back below
+		if(h->kind == SN_VAR)
+			l = dbNewVar(depth - 1 - h->level);
+		else {
+			l = dbNew(DB_FREE);
+			DB_SETNAME(l, h->name);
+		}
+
+		// the arguments are in the stack, the innermost application first
+		for(i = argNo - 1; i > 0; i--) {
+			if(!(t = readback(stack[argBase + i]->r, depth)))
+				return DB_NULL;
+			l = dbNewAppl(l, t);
+		}
+
+		if(argNo == 0) {
+			sp = argBase;
+			t = l;
+			break;
+		}
+
+		if(chainNo == chainSize &&
+			!(chain = realloc(chain, (chainSize = chainSize ? 2 * chainSize : 256) * sizeof(DBTERM)))) {
+			fprintf(stderr, "Error: out of memory.\n");
+			exit(1);
+		}
+		t = dbNew(DB_APPL);
+		DB_L(t) = l;
+		chain[chainNo++] = t;
+
+		n = stack[argBase]->r;
+		sp = argBase;
+	}
+
+	// fill in the chain, from the innermost application
+	for(i = chainNo - 1; i >= base; i--) {
+		DB_R(chain[i]) = t;
+		DB_LOOSE(chain[i]) = LOOSE_APPL(DB_LOOSE(DB_L(chain[i])), DB_LOOSE(t));
+		t = chain[i];
+	}
+	chainNo = base;
+
+	return t;
+}
+
+
+// ------- Engine interface --------
+
+static void *skiStart(TERM *t) {
+	SSTATE *st = arenaAlloc(sizeof(SSTATE));
+
+	combinators = 0;
+	st->node = compile(dbFromTerm(t), 0);
+	st->t = t;
+	st->res = DB_NULL;
+	st->shown = NULL;
+	return st;
+}
+
+// skiStep
+//
+// Computes the normal form in one go, returns the number of combinator
+// reductions performed
+
+static int skiStep(void *state) {
+	SSTATE *st = state;
+
+	if(st->res)
+		return 0;
+
+	reductions = sp = chainNo = 0;
+	traced = trace;
+	if(!(st->res = readback(st->node, 0)))
+		return memExceeded && reductions ? reductions : -1;
+
+	return reductions;
+}
+
+static TERM *skiTerm(void *state) {
+	SSTATE *st = state;
+
+	if(!st->res)
+		return st->t;
+
+	termFree(st->shown);
+	st->shown = dbToTerm(st->res);
+	return st->shown;
+}
+
+static void skiStats(void *state) {
+	(void)state;
+	printf(", %d combinators", combinators);
+}
+
+ENGINE skiEngine = { "ski", skiStart, skiStep, skiTerm, skiStats };
@@ -0,0 +1,126 @@
+// vim:noet:ts=3
+
+/* Symbol table for interned names
+
+	Copyright (C) 2004-8 Kostas Chatzikokolakis
+	This file is part of LCI
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details. */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "symbol.h"
+
+
+SYMBOL **symTable = NULL;
+unsigned long symTableSize = 0,
+				  symNo = 0;
+char **symNames = NULL;
+
+
+// hashName
+//
+// FNV-1a hash of a string
+
+static unsigned long hashName(const char *s) {
+	unsigned long h = 2166136261UL;
+
+	for(; *s; s++)
+		h = (h ^ (unsigned char)*s) * 16777619UL;
+
+	return h;
+}
+
+// growTable
+//
+// Doubles the number of buckets and rehashes all symbols. symNames grows
+// along, it has one more entry than the symbols (id 0).
+
+static void growTable() {
+	unsigned long newSize = symTableSize ? 2 * symTableSize : SYMTAB_INITSIZE, i, h;
+	SYMBOL **newTable = calloc(newSize, sizeof(SYMBOL*)), *s, *next;
+
+	for(i = 0; i < symTableSize; i++)
+		for(s = symTable[i]; s; s = next) {
+			next = s->next;
+			h = hashName(s->name) & (newSize - 1);
+			s->next = newTable[h];
+			newTable[h] = s;
+		}
+
+	free(symTable);
+	symTable = newTable;
+	symTableSize = newSize;
+
+	if(!(symNames = realloc(symNames, (newSize + 1) * sizeof(char*)))) {
+		fprintf(stderr, "Error: out of memory.\n");
+		exit(1);
+	}
+	symNames[0] = NULL;
+}
+
+// intern
+//
+// Returns the unique copy of name, creating it if this is the first time the
+// name is seen. The returned string must never be modified or freed.
+
+char *intern(const char *name) {
+	unsigned long h;
+	SYMBOL *s;
+
+	if(symNo >= symTableSize)
+		growTable();
+
+	h = hashName(name) & (symTableSize - 1);
+	for(s = symTable[h]; s; s = s->next)
+		if(strcmp(s->name, name) == 0)
+			return s->name;
+
+	s = malloc(sizeof(SYMBOL) + strlen(name));
+	strcpy(s->name, name);
+	s->value = NULL;
+	s->id = ++symNo;
+	s->next = symTable[h];
+	symTable[h] = s;
+	symNames[s->id] = s->name;
+
+	return s->name;
+}
+
+// symbolGet
+//
+// Returns the binding of the interned name
+
+void *symbolGet(char *name) {
+	return SYMBOL_OF(name)->value;
+}
+
+// symbolSet
+//
+// Changes the binding of the interned name
+
+void symbolSet(char *name, void *value) {
+	SYMBOL_OF(name)->value = value;
+}
+
+// symbolId
+//
+// Returns the number of the interned name (0 for NULL)
+
+int symbolId(char *name) {
+	return name ? SYMBOL_OF(name)->id : 0;
+}
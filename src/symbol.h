@@ -0,0 +1,54 @@
+// vim:noet:ts=3
+
+/* Declarations for symbol.c
+
+	Copyright (C) 2004-8 Kostas Chatzikokolakis
+	This file is part of LCI
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details. */
+
+#ifndef SYMBOL_H
+#define SYMBOL_H
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stddef.h>
+
+#define SYMTAB_INITSIZE	256			// initial number of buckets (power of 2)
+
+// All variable and alias names are interned: there is a single copy of each
+// name, so two names are equal iff their pointers are equal. The name is
+// stored at the end of its symbol record, which also holds the symbol's
+// binding (the declaration of an alias). Symbols are also numbered, so that
+// a name can be stored in less space than a pointer (id 0 stands for NULL).
+typedef struct tag_symbol {
+	struct tag_symbol *next;			// next symbol in the same bucket
+	void *value;							// binding of the symbol, NULL if unbound
+	int id;
+	char name[1];
+} SYMBOL;
+
+#define SYMBOL_OF(name)		((SYMBOL*)((name) - offsetof(SYMBOL, name)))
+
+extern char **symNames;				// symNames[id] is the name of symbol id
+
+
+char *intern(const char *name);
+void *symbolGet(char *name);
+void symbolSet(char *name, void *value);
+int symbolId(char *name);
+
+#define symbolName(id)		(symNames[id])
+
+
+#endif
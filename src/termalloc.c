@@ -0,0 +1,402 @@
+// vim:noet:ts=3
+
+/* Slab allocator for terms and other small objects
+
+	Copyright (C) 2004-8 Kostas Chatzikokolakis
+	This file is part of LCI
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details. */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#if HAVE_LIBPTHREAD && HAVE_PTHREAD_H
+#define USE_RECLAIMER
+#include <pthread.h>
+#endif
+
+#include "termalloc.h"
+
+
+ARENA arenas[AR_NO];
+ARENA *curArena = &arenas[AR_QUERY];
+CHUNK *surplus = NULL;					// chunks waiting to be returned to the system
+size_t memLimit = 0;						// max bytes a query may allocate, 0 for no limit
+int memExceeded = 0;						// set when the query arena grows beyond memLimit
+
+#define SIZE_CLASS(s)	(((s) + SLAB_ALIGN - 1) / SLAB_ALIGN - 1)
+#define BLOCK_SIZE(s)	((SIZE_CLASS(s) + 1) * SLAB_ALIGN)
+
+
+// arenaSelect
+//
+// Makes arena id the one used by all subsequent allocations and returns the
+// previously selected arena. Terms must be freed while the arena they were
+// allocated from is selected.
+
+ARENA_ID arenaSelect(ARENA_ID id) {
+	ARENA_ID prev = curArena - arenas;
+
+	curArena = &arenas[id];
+	return prev;
+}
+
+// arenaCurrent
+//
+// Returns the arena used by allocations
+
+ARENA_ID arenaCurrent() {
+	return curArena - arenas;
+}
+
+// freeChunks
+//
+// Returns at most n chunks of list *l to the system, n = -1 frees all of them
+
+static void freeChunks(CHUNK **l, int n) {
+	CHUNK *c;
+
+	for(; *l && n != 0; n--) {
+		c = *l;
+		*l = c->next;
+		free(c);
+	}
+}
+
+#ifdef USE_RECLAIMER
+
+pthread_mutex_t reclaimLock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t reclaimCond = PTHREAD_COND_INITIALIZER;
+int reclaimer = 0;						// 1 if running, -1 if it could not be started
+
+// reclaimerMain
+//
+// Body of the reclaimer thread, frees the surplus chunks whenever there are any
+
+static void *reclaimerMain(void *arg) {
+	CHUNK *l;
+
+	(void)arg;
+	pthread_mutex_lock(&reclaimLock);
+	for(;;) {
+		while(!surplus)
+			pthread_cond_wait(&reclaimCond, &reclaimLock);
+
+		l = surplus;
+		surplus = NULL;
+
+		pthread_mutex_unlock(&reclaimLock);
+		freeChunks(&l, -1);
+		pthread_mutex_lock(&reclaimLock);
+	}
+	return NULL;
+}
+
+#endif
+
+// releaseChunks
+//
+// Hands a list of chunks over to be returned to the system. This is done by a
+// background thread if possible, otherwise newChunk frees a few of them at a
+// time, so no single allocation or reset has to free a large amount of memory.
+
+static void releaseChunks(CHUNK *first, CHUNK *last) {
+#ifdef USE_RECLAIMER
+	pthread_t th;
+
+	// the thread runs until the program exits, so it does not matter if it
+	// cannot be detached
+	if(reclaimer == 0 &&
+		(reclaimer = pthread_create(&th, NULL, reclaimerMain, NULL) == 0 ? 1 : -1) == 1)
+		pthread_detach(th);
+
+	if(reclaimer == 1) {
+		pthread_mutex_lock(&reclaimLock);
+		last->next = surplus;
+		surplus = first;
+		pthread_cond_signal(&reclaimCond);
+		pthread_mutex_unlock(&reclaimLock);
+		return;
+	}
+#endif
+
+	last->next = surplus;
+	surplus = first;
+}
+
+// newChunk
+//
+// Makes a new chunk the current one in arena a. Chunks kept by a previous
+// reset are reused before asking malloc for more memory.
+
+static void newChunk(ARENA *a) {
+	CHUNK *c;
+
+#ifdef USE_RECLAIMER
+	if(reclaimer != 1)
+#endif
+		freeChunks(&surplus, SLAB_TRIM_STEP);
+
+	if(a->spare) {
+		c = a->spare;
+		a->spare = c->next;
+		a->spareNo--;
+	} else if(!(c = malloc(SLAB_CHUNK_SIZE))) {
+		fprintf(stderr, "Error: out of memory.\n");
+		exit(1);
+	}
+
+	c->next = a->chunks;
+	a->chunks = c;
+	a->chunkNo++;
+	arenaCharge(a - arenas, SLAB_CHUNK_SIZE);
+	if(!a->last) a->last = c;
+
+	a->top = (char*)c->data;
+	a->end = (char*)c + SLAB_CHUNK_SIZE;
+}
+
+// arenaCharge
+//
+// Records that size more bytes were obtained from the system for arena id. If
+// the query arena exceeds memLimit the memExceeded flag is set, the allocation
+// itself still succeeds and execTerm stops the query after the current step.
+
+void arenaCharge(ARENA_ID id, size_t size) {
+	ARENA *a = &arenas[id];
+
+	a->size += size;
+	if(memLimit && id == AR_QUERY && a->size > memLimit)
+		memExceeded = 1;
+}
+
+// arenaRoom
+//
+// Returns 1 if size more bytes can be obtained for the current arena without
+// exceeding memLimit. Otherwise sets the memExceeded flag and returns 0, so that
+// a builtin can give up before building a large number or list in one step.
+
+int arenaRoom(size_t size) {
+	ARENA *a = curArena;
+
+	if(!memLimit || a != &arenas[AR_QUERY] || a->size + size <= memLimit)
+		return 1;
+
+	memExceeded = 1;
+	return 0;
+}
+
+// arenaAlloc
+//
+// Returns a block of (at least) size bytes from the current arena. Blocks are
+// grouped in size classes of SLAB_ALIGN bytes, a freed block of the same class
+// is preferred to carving a new one from the current chunk.
+
+void *arenaAlloc(size_t size) {
+	ARENA *a = curArena;
+	int cl = SIZE_CLASS(size);
+	void *p;
+
+	assert(cl >= 0 && cl < SLAB_CLASSES);
+
+	a->liveNo++;
+	a->liveSize += BLOCK_SIZE(size);
+
+	if((p = a->freeList[cl])) {
+		a->freeList[cl] = *(void**)p;
+		return p;
+	}
+
+	size = (cl + 1) * SLAB_ALIGN;
+	if(a->top + size > a->end)
+		newChunk(a);
+
+	p = a->top;
+	a->top += size;
+	return p;
+}
+
+// arenaFree
+//
+// Returns a block obtained by arenaAlloc to the free list of its size class.
+
+void arenaFree(void *p, size_t size) {
+	int cl = SIZE_CLASS(size);
+
+	*(void**)p = curArena->freeList[cl];
+	curArena->freeList[cl] = p;
+
+	curArena->liveNo--;
+	curArena->liveSize -= BLOCK_SIZE(size);
+}
+
+// arenaAllocBig
+//
+// Returns a block of any size from the current arena. Such blocks cannot be
+// freed individually, they are released only by arenaReset. Small ones are
+// carved from the current chunk, the rest get a malloc'ed block of their own.
+
+void *arenaAllocBig(size_t size) {
+	ARENA *a = curArena;
+	CHUNK *c;
+	void *p;
+
+	size = (size + SLAB_ALIGN - 1) / SLAB_ALIGN * SLAB_ALIGN;
+	a->liveSize += size;
+
+	if(size > SLAB_CHUNK_SIZE / 4) {
+		if(!(c = malloc(offsetof(CHUNK, data) + size))) {
+			fprintf(stderr, "Error: out of memory.\n");
+			exit(1);
+		}
+		c->next = a->large;
+		a->large = c;
+		arenaCharge(a - arenas, offsetof(CHUNK, data) + size);
+		return c->data;
+	}
+
+	if(a->top + size > a->end)
+		newChunk(a);
+
+	p = a->top;
+	a->top += size;
+	return p;
+}
+
+// arenaReset
+//
+// Releases everything allocated in arena id in constant time. Up to
+// SLAB_SPARE_MAX chunks are not returned to the system but kept for the
+// following allocations, so that consecutive queries do not keep mapping and
+// unmapping the same pages. The rest (left by a large query) are handed to
+// releaseChunks.
+
+void arenaReset(ARENA_ID id) {
+	ARENA *a = &arenas[id];
+	CHUNK *c;
+	int n = SLAB_SPARE_MAX - a->spareNo;		// chunks that can still be kept
+
+	if(a->chunks && n >= a->chunkNo) {
+		a->last->next = a->spare;
+		a->spare = a->chunks;
+		a->spareNo += a->chunkNo;
+
+	} else if(a->chunks) {
+		for(a->spareNo += n; n > 0; n--) {
+			c = a->chunks;
+			a->chunks = c->next;
+			c->next = a->spare;
+			a->spare = c;
+		}
+		releaseChunks(a->chunks, a->last);
+	}
+	freeChunks(&a->large, -1);
+
+	a->chunks = a->last = NULL;
+	a->chunkNo = 0;
+	a->size = a->liveSize = 0;
+	a->liveNo = 0;
+	a->top = a->end = NULL;
+	memset(a->freeList, 0, sizeof(a->freeList));
+	a->termList = NULL;
+}
+
+// termFree
+//
+// Free a TERM's memory
+//
+// The term is put in the free list of the current arena, its children are
+// released only when the term is reused by termNew, so termFree takes constant
+// time regardless of the size of the term. Names are interned (never freed) so
+// the name field is used to link the list. For a shared term only a reference
+// is released, the term is freed when its last one goes. Terms in the free list
+// are not counted as live, their children are until the term is reused.
+
+void termFree(TERM *t) {
+	// if NULL do nothing
+	if(!t) return;
+
+	if(t->shared && (t->refs == REFS_PERM || --t->refs > 0))
+		return;
+
+	t->name = (char*)curArena->termList;
+	curArena->termList = t;
+	curArena->liveNo--;
+	curArena->liveSize -= BLOCK_SIZE(sizeof(TERM));
+}
+
+// termFreeNode
+//
+// Frees only the node t, without its children (used when the contents of a
+// private node have been copied to some other node).
+
+void termFreeNode(TERM *t) {
+	if(t->shared) return;
+
+	t->type = TM_VAR;
+	t->name = (char*)curArena->termList;
+	curArena->termList = t;
+	curArena->liveNo--;
+	curArena->liveSize -= BLOCK_SIZE(sizeof(TERM));
+}
+
+// termRef
+//
+// Adds a reference to shared term t. The count saturates, a term referenced
+// that many times is kept until the end of the query.
+
+void termRef(TERM *t) {
+	if(t->refs != REFS_PERM)
+		t->refs++;
+}
+
+// termGC
+//
+// Releases all terms of the running query.
+
+void termGC() {
+	arenaReset(AR_QUERY);
+}
+
+// termNew
+//
+// Returns a new term. Recycled terms would otherwise keep the preced, closed
+// and shared fields of their previous use, so these are always reset (many
+// callers only set type, name and children).
+
+TERM *termNew() {
+	TERM *t;
+
+	if((t = curArena->termList)) {
+		curArena->termList = (TERM*)t->name;
+		curArena->liveNo++;
+		curArena->liveSize += BLOCK_SIZE(sizeof(TERM));
+
+		if(t->type == TM_APPL || t->type == TM_ABSTR) {
+			termFree(t->lterm);
+			termFree(t->rterm);
+		}
+	} else
+		t = arenaAlloc(sizeof(TERM));
+
+	t->preced = 0;
+	t->closed = 0;
+	t->shared = 0;
+	t->refs = 0;
+
+	return t;
+}
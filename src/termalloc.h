@@ -0,0 +1,82 @@
+// vim:noet:ts=3
+
+/* Declarations for termalloc.c
+
+	Copyright (C) 2004-8 Kostas Chatzikokolakis
+	This file is part of LCI
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details. */
+
+#ifndef TERMALLOC_H
+#define TERMALLOC_H
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stddef.h>
+
+#include "grammar.h"
+
+#define SLAB_CHUNK_SIZE	(64 * 1024)		// bytes carved from malloc at a time
+#define SLAB_ALIGN		8					// size classes are multiples of SLAB_ALIGN
+#define SLAB_CLASSES		8					// so the largest class holds 64 bytes
+#define SLAB_SPARE_MAX	64					// chunks kept by a reset, the rest are freed
+#define SLAB_TRIM_STEP	4					// chunks freed per new chunk (without a reclaimer thread)
+
+#define REFS_PERM			0xffff			// refs of terms that are never freed (declarations)
+
+// Memory is organised in arenas. Terms that live as long as the program
+// (declarations) are kept in AR_DECL, everything created while parsing and
+// executing a query goes to AR_QUERY, which is reset in one go when the
+// query finishes.
+typedef enum { AR_QUERY = 0, AR_DECL, AR_NO } ARENA_ID;
+
+typedef struct tag_chunk {
+	struct tag_chunk *next;
+	double data[1];						// double forces the alignment of the payload
+} CHUNK;
+
+typedef struct {
+	CHUNK *chunks, *last;				// chunks in use (last is needed for an O(1) reset)
+	CHUNK *spare;							// chunks kept from previous resets
+	CHUNK *large;							// blocks too big for a chunk (see arenaAllocBig)
+	int chunkNo, spareNo;
+	size_t size;							// bytes obtained from the system since the last reset
+	long liveNo;							// objects allocated and not freed
+	size_t liveSize;						// and their size in bytes
+	char *top, *end;						// bump pointer inside the current chunk
+	void *freeList[SLAB_CLASSES];		// one free list per size class
+	TERM *termList;						// freed terms, their children are released lazily
+} ARENA;
+
+extern ARENA arenas[AR_NO];
+extern size_t memLimit;
+extern int memExceeded;
+
+
+ARENA_ID arenaSelect(ARENA_ID id);
+ARENA_ID arenaCurrent();
+void *arenaAlloc(size_t size);
+void arenaFree(void *p, size_t size);
+void *arenaAllocBig(size_t size);
+void arenaReset(ARENA_ID id);
+void arenaCharge(ARENA_ID id, size_t size);
+int arenaRoom(size_t size);
+
+TERM *termNew();
+void termFree(TERM *t);
+void termFreeNode(TERM *t);
+void termRef(TERM *t);
+void termGC();
+
+
+#endif
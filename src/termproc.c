@@ -23,20 +23,98 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <limits.h>
 
-#include "kazlib/list.h"
 
 #include "termproc.h"
+#include "symbol.h"
 #include "decllist.h"
 #include "parser.h"
 #include "run.h"
+#include "prim.h"
 
+static void termClosedFlag(TERM *t, int keep);
 
-#define DEFAULT_POOL_SIZE 500
-TERM **termPool = NULL;
-int termPoolSize = 0;
-int termPoolIndex = -1;
+// The traversals of terms use an explicit stack instead of recursion, so that
+// deep terms (large numerals, long lists) cannot overflow the C stack. The stack
+// is made of blocks which are never moved or freed, so the address of an item
+// stays valid while the item is in the stack. Each traversal pops only what it
+// has pushed, so traversals can be nested (a traversal remembers the top of the
+// stack when it starts and finishes when the top is back there).
 
+#define STACK_BLOCK	1024					// items per block
+
+typedef union {
+	TERM *t;
+	TERM **pt;
+	char *s;
+	int n;
+} STACKITEM;
+
+typedef struct tag_stackblock {
+	struct tag_stackblock *prev, *next;
+	STACKITEM items[STACK_BLOCK];
+} STACKBLOCK;
+
+static STACKBLOCK stackFirst;
+static STACKBLOCK *stackCur = &stackFirst;
+static STACKITEM *stackPtr = stackFirst.items,
+					  *stackEnd = stackFirst.items + STACK_BLOCK,
+					  *stackBottom = NULL;		// popping this item leaves the current block
+
+#define PUSH(f, v)	((stackPtr == stackEnd ? stackNext() : stackPtr++)->f = (v))
+#define POP(f)			((stackPtr == stackBottom ? stackPrev() : --stackPtr)->f)
+#define STACK_TOP		(stackPtr - 1)
+
+// Stages of termSubst and termReduce, what remains to be done for a term when
+// its child is finished
+typedef enum { ST_NONE = 0, ST_LEFT, ST_RIGHT, ST_BODY, ST_VALUE, ST_ARG1, ST_ARG2, ST_AGAIN } STAGE;
+#define ST_OWNREF		8						// flag of stages, the child is held by the stack item
+
+// stackNext
+//
+// Moves to the next block when the current one is full, returns the first item
+
+static STACKITEM *stackNext() {
+	STACKBLOCK *b = stackCur->next;
+
+	if(!b) {
+		if(!(b = malloc(sizeof(STACKBLOCK)))) {
+			fprintf(stderr, "Error: out of memory.\n");
+			exit(1);
+		}
+		b->prev = stackCur;
+		b->next = NULL;
+		stackCur->next = b;
+	}
+
+	stackCur = b;
+	stackPtr = stackBottom = b->items + 1;
+	stackEnd = b->items + STACK_BLOCK;
+	return b->items;
+}
+
+// stackPrev
+//
+// Pops the first item of the current block and moves back to the previous one
+
+static STACKITEM *stackPrev() {
+	STACKITEM *item = stackCur->items;
+
+	stackCur = stackCur->prev;
+	stackPtr = stackEnd = stackCur->items + STACK_BLOCK;
+	stackBottom = stackCur == &stackFirst ? NULL : stackCur->items + 1;
+	return item;
+}
+
+// printLater
+//
+// Pushes string s in the stack of termPrint
+
+static void printLater(char *s) {
+	PUSH(s, s);
+	PUSH(n, -1);
+}
 
 // termPrint
 //
@@ -44,160 +122,456 @@ int termPoolIndex = -1;
 // If showPar = 0 then only the required parentheses are printed
 // If greeklambda = 1 then a greek lambda character is used instead of "\"
 // (must have your terminal set to use UTF-8 as its locale to display)
+//
+// What remains to be printed is kept in the stack, either strings (n = -1) or
+// terms together with their isMostRight flag.
 
 void termPrint(TERM *t, int isMostRight) {
 	char showPar = getOption(OPT_SHOWPAR),
 		greekLambda = getOption(OPT_GREEKLAMBDA),
 		readable = getOption(OPT_READABLE);
-	int num;
+	STACKITEM *base = stackPtr;
+	TERM *c;
+	int num, par;
 
-	switch(t->type) {
-	 case TM_VAR:
-	 case TM_ALIAS:
-		printf("%s", t->name);
-		break;
+	for(;;) {
+		switch(t->type) {
+		 case TM_VAR:
+		 case TM_ALIAS:
+			printf("%s", t->name);
+			break;
 
-	 case TM_ABSTR:
-		if(readable && termIdentity(t))
-		    putchar('1');
-		else if(readable && (num = termBoolean(t)) != -1)
-		    printf("%s", num ? "True" : "0");
-		else if(readable && (num = termNatural(t)) != -1)
-			printf("%d", num);
-		else if(readable && termIsString(t))
-			termPrintString(t);
-		else if(readable && termIsPair(t))
-			termPrintPair(t);
-		else if(readable && termIsMaybe(t))
-			termPrintMaybe(t);
-		else if(readable && termIsList(t))
-			termPrintList(t);
-		else {
-			if(showPar || !isMostRight) printf("(");
+		 case TM_NUM:
+			if(t->big)
+				bigPrint(t->big);						// too large to be written out
+			else if(readable)
+				printf("%d", t->num);
+			else {
+				c = termChurchNum(t->num);
+				termPrint(c, isMostRight);
+				termFree(c);
+			}
+			break;
 
-			printf(greekLambda ? "\u03BB" : "\\");
-			termPrint(t->lterm, 0);
-			printf(".");
-			termPrint(t->rterm, 1);
+		 case TM_LIST:
+			// the encoding is recognized as a list or a string
+			c = termFromList(t->list);
+			termPrint(c, isMostRight);
+			termFree(c);
+			break;
+
+		 case TM_ABSTR:
+			if(readable && termIdentity(t))
+			    putchar('1');
+			else if(readable && (num = termBoolean(t)) != -1)
+			    printf("%s", num ? "True" : "0");
+			else if(readable && (num = termNatural(t)) != -1)
+				printf("%d", num);
+			else if(readable && termIsString(t))
+				termPrintString(t);
+			else if(readable && termIsPair(t))
+				termPrintPair(t);
+			else if(readable && termIsMaybe(t))
+				termPrintMaybe(t);
+			else if(readable && termIsList(t))
+				termPrintList(t);
+			else {
+				if(showPar || !isMostRight) {
+					printf("(");
+					printLater(")");
+				}
+
+				printf(greekLambda ? "\u03BB" : "\\");
+				printf("%s.", t->lterm->name);
+
+				t = t->rterm;
+				isMostRight = 1;
+				continue;
+			}
+			break;
 
-			if(showPar || !isMostRight) printf(")");
+		 case TM_APPL:
+			if(showPar) {
+				printf("(");
+				printLater(")");
+			}
+
+			par = !showPar && t->rterm->type == TM_APPL;
+			if(par) printLater(")");
+			PUSH(t, t->rterm);
+			PUSH(n, isMostRight);
+			if(par) printLater("(");
+
+			//if(t->name)
+				//printf(" %s ", t->name);
+			//else
+				printLater(" ");
+
+			t = t->lterm;
+			isMostRight = 0;
+			continue;
 		}
-		break;
 
-	 case TM_APPL:
-		if(showPar) printf("(");
+		// print the strings on top of the stack and continue with the next term
+		for(;;) {
+			if(stackPtr == base) return;
+			if((num = POP(n)) != -1) break;
+			fputs(POP(s), stdout);
+		}
+		isMostRight = num;
+		t = POP(t);
+	}
+}
 
-		termPrint(t->lterm, 0);
+// termClone
+//
+// Creates and returns a clone of a term (and all its subterms).
+// Right children still to be cloned are kept in the stack, together with the
+// slot of the clone where their own clone goes.
 
-		//if(t->name)
-			//printf(" %s ", t->name);
-		//else
-			printf(" ");
+TERM *termClone(TERM *t) {
+	STACKITEM *base = stackPtr;
+	TERM *root, **slot = &root, *newTerm;
 
-		if(!showPar && t->rterm->type == TM_APPL) printf("(");
-		termPrint(t->rterm, isMostRight);
-		if(!showPar && t->rterm->type == TM_APPL) printf(")");
+	for(;;) {
+		newTerm = termNew();
+		newTerm->type = t->type;
+		newTerm->preced = t->preced;
+		newTerm->closed = t->closed;
+		//newTerm->assoc = t->assoc;			// assoc used only in parsing, no need to copy it
+		*slot = newTerm;
+
+		if(t->type == TM_VAR || t->type == TM_ALIAS || t->type == TM_NUM || t->type == TM_LIST) {
+			newTerm->name = t->name;
+			if(t->type == TM_NUM) {
+				newTerm->num = t->num;
+				// numbers of the query are not kept by declarations
+				newTerm->big = t->big && arenaCurrent() == AR_DECL ? bigClone(t->big) : t->big;
+			} else if(t->type == TM_LIST)
+				newTerm->list = arenaCurrent() == AR_DECL ? listClone(t->list) : t->list;
+
+			if(stackPtr == base) return root;
+			t = POP(t);
+			slot = POP(pt);
+		} else {													//TM_ABRST or TM_APPL
+			newTerm->name = NULL;
+
+			PUSH(pt, &newTerm->rterm);
+			PUSH(t, t->rterm);
+			slot = &newTerm->lterm;
+			t = t->lterm;
+		}
+	}
+}
 
-		if(showPar) printf(")");
-		break;
+// termMove
+//
+// Moves the contents of term s to the private term d, releasing the reference to
+// s. If s is shared it stays in use elsewhere, so its children get one more
+// reference (from d).
+
+static void termMove(TERM *d, TERM *s) {
+	*d = *s;
+	d->shared = 0;
+	d->refs = 0;
+
+	if(!s->shared) {
+		termFreeNode(s);
+		return;
+	}
+
+	if(s->type == TM_APPL || s->type == TM_ABSTR) {
+		termRef(s->lterm);
+		termRef(s->rterm);
 	}
+	termFree(s);
 }
 
-// termFree
+// termUnshare
 //
-// Free a TERM's memory
+// Makes the term at *pt writable. A shared term is replaced in *pt by a copy of
+// its root node, the children stay shared, so a modification deep inside a
+// shared term copies only the path leading to it. *pt must hold a reference of
+// its own to the term (it is released).
+
+static TERM *termUnshare(TERM **pt) {
+	TERM *t = *pt;
+
+	if(t->shared) {
+		t = termNew();
+		termMove(t, *pt);
+		*pt = t;
+	}
+	return t;
+}
 
-void termFree(TERM *t) {
-	TERM **newPool;
-	int i;
+// termShare
+//
+// Returns a new reference to term t, making it shared (with all its private
+// subterms) if it is not already. Every subterm of a shared term is shared.
+
+static void termMarkShared(TERM *t) {
+	STACKITEM *base = stackPtr;
+
+	for(;;) {
+		t->shared = 1;
+		t->refs = 1;
+
+		if(t->type == TM_APPL || t->type == TM_ABSTR) {
+			if(!t->rterm->shared) PUSH(t, t->rterm);
+			if(!t->lterm->shared) {
+				t = t->lterm;
+				continue;
+			}
+		}
+
+		if(stackPtr == base) return;
+		t = POP(t);
+	}
+}
+
+static TERM *termShare(TERM *t) {
+	if(!t->shared)
+		termMarkShared(t);
+
+	termRef(t);
+	return t;
+}
+
+// termSetChild
+//
+// Replaces the left (right = 0) or right child of shared term *pt with c. *pt is
+// unshared, the reference of the copy to the old child is released.
+
+static void termSetChild(TERM **pt, int right, TERM *c) {
+	TERM *t = termUnshare(pt),
+		  **slot = right ? &t->rterm : &t->lterm;
+
+	termFree(*slot);
+	*slot = c;
+}
+
+// Call-by-need
+//
+// An argument substituted in several places is shared by all of them (see
+// termSubst), its nodes have counted references, unlike the nodes of
+// declarations which are never freed. With call-by-need such shared terms
+// (thunks) are reduced in place, so each argument is reduced at most once and
+// all its uses see the result. Everything else stays as in normal order,
+// declarations and the substitutions in thunks (which depend on the place of
+// each use) are still copied on write.
+
+static char needMode;					// the strategy is STR_NEED
+static char valueMode;					// the strategy is STR_VALUE (see APPL_STRICT)
+
+#define TERM_THUNK(t)	((t)->shared && (t)->refs != REFS_PERM)
+#define WRITABLE(t)		(!(t)->shared || (needMode && TERM_THUNK(t)))
+
+// termWritable
+//
+// Like termUnshare, but with call-by-need a thunk is returned as is
+
+static TERM *termWritable(TERM **pt) {
+	return needMode && TERM_THUNK(*pt)
+		? *pt
+		: termUnshare(pt);
+}
 
-	// if NULL do nothing
-	if(!t) return;
+// termReplace
+//
+// Moves the contents of term s to term t (obtained by termWritable). A thunk
+// stays shared, its new children become shared too (every subterm of a shared
+// term is shared).
 
-	termPoolIndex++;
+static void termReplace(TERM *t, TERM *s) {
+	char shared = t->shared;
+	unsigned short refs = t->refs;
 
-	// if the pool is full then create a new one of twice the size
-	if(termPoolIndex >= termPoolSize) {
-		termPoolSize = termPoolSize == 0 ? DEFAULT_POOL_SIZE : 2*termPoolSize;
-		newPool = malloc(termPoolSize * sizeof(TERM*));
+	termMove(t, s);
 
-		// copy terms to new pool
-		for(i = 0; i < termPoolIndex; i++)
-			newPool[i] = termPool[i];
+	if(shared) {
+		t->shared = shared;
+		t->refs = refs;
 
-		free(termPool);
-		termPool = newPool;
+		if(t->type == TM_APPL || t->type == TM_ABSTR) {
+			if(!t->lterm->shared) termMarkShared(t->lterm);
+			if(!t->rterm->shared) termMarkShared(t->rterm);
+		}
 	}
+}
+
+// Packed lists
+//
+// A TM_LIST term stands for the encoding of its list (see packed.h), either in
+// normal form (termFromList) or unfolded by one element (termUnfoldList) when
+// it is applied. The elements themselves are not copied.
+
+// termNode
+//
+// Returns a new application or abstraction of l and r, or variable name if type
+// is TM_VAR
+
+static TERM *termNode(TERM_TYPE type, TERM *l, TERM *r, char *name) {
+	TERM *t = termNew();
 
-	// put the term in the pool
-	termPool[termPoolIndex] = t;
+	t->type = type;
+	t->name = type == TM_VAR ? intern(name) : NULL;
+	if(type != TM_VAR) {
+		t->lterm = l;
+		t->rterm = r;
+	}
+	return t;
+}
+
+#define VAR(name)		termNode(TM_VAR, NULL, NULL, name)
+#define APPL(l, r)	termNode(TM_APPL, l, r, NULL)
+#define ABSTR(x, m)	termNode(TM_ABSTR, VAR(x), m, NULL)
+
+// termEmptyString
+//
+// Returns Empty (\x.True), the end of a string
+
+static TERM *termEmptyString() {
+	return ABSTR("x", ABSTR("x", ABSTR("y", VAR("x"))));
 }
 
-void termGC() {
-	while(termPoolIndex >= 0)
-		free(termNew());
+// termSetList
+//
+// Makes t the list l, or Nil (0) if l is NULL or empty
 
-	if(termPoolSize > DEFAULT_POOL_SIZE) {
-		free(termPool);
-		termPool = NULL;
-		termPoolSize = 0;
+void termSetList(TERM *t, LIST *l) {
+	if(!l || l->size == 0) {
+		termSetNumeral(t, 0, NULL);
+		return;
 	}
-	termPoolIndex = -1;
+
+	t->type = TM_LIST;
+	t->name = NULL;
+	t->list = l;
+	t->closed = 1;
 }
 
-TERM *termNew() {
-	TERM *t;
+// termFromList
+//
+// Returns the encoding of list l in normal form (as built by Cons or
+// ToString), the list of one element is eta-reduced to \c.c A. 1 stands for
+// \f.f there. The elements are shared with l, the result must be freed by
+// termFree.
 
-	if(termPoolIndex >= 0) {
-		t = termPool[termPoolIndex];
-		termPoolIndex--;
+TERM *termFromList(LIST *l) {
+	TERM *t, *e;
+	int i;
 
-		switch(t->type) {
-		 case TM_VAR:
-		 case TM_ALIAS:
-			free(t->name);
-			break;
-	
-		 case TM_APPL:
-			free(t->name);
-		 case TM_ABSTR:
-			termFree(t->lterm);
-			termFree(t->rterm);
-			break;
-		}
-	} else
-		t = malloc(sizeof(TERM));
+	t = l->kind == LS_STRING ? termEmptyString() : l->size > 1 ? VAR("n") : NULL;
 
+	for(i = l->size - 1; i >= 0; i--) {
+		e = l->elem[i];
+		if(e->type == TM_NUM && !e->big && e->num == 1)
+			e = ABSTR("f", VAR("f"));
+
+		if(l->kind == LS_STRING)
+			t = ABSTR("z", APPL(APPL(VAR("z"), e), t));
+		else
+			t = t ? APPL(APPL(VAR("c"), e), t) : APPL(VAR("c"), e);
+	}
+
+	if(l->kind == LS_LIST)
+		t = ABSTR("c", l->size == 1 ? t : ABSTR("n", t));
 	return t;
 }
 
-// termClone
+// termUnfoldList
 //
-// Creates and returns a clone of a term (and all its subterms).
+// Returns the encoding of list l with its first element only, the rest is
+// another TM_LIST: \c.\n.c A (R c n), or \z.z A R for a string.
 
-TERM *termClone(TERM *t) {
-	TERM *newTerm;
+static TERM *termUnfoldList(LIST *l) {
+	TERM *t, *r = NULL;
+
+	if(l->size > 1) {
+		r = termNew();
+		termSetList(r, listSlice(l, 1, l->size - 1));
+	}
+
+	if(l->kind == LS_STRING)
+		t = ABSTR("z", APPL(APPL(VAR("z"), l->elem[0]), r ? r : termEmptyString()));
+	else
+		t = ABSTR("c", ABSTR("n", APPL(APPL(VAR("c"), l->elem[0]),
+			r ? APPL(APPL(r, VAR("c")), VAR("n")) : VAR("n"))));
+
+	t->closed = 1;
+	return t;
+}
+
+#undef VAR
+#undef APPL
+#undef ABSTR
+
+// LIST_NORMAL
+//
+// A list is in normal form if its elements are, apart from a list of one
+// element, which contains an eta-redex (like 1)
+
+#define LIST_NORMAL(l)	((l)->nf && ((l)->size > 1 || (l)->kind == LS_STRING))
+
+// termExpand
+//
+// Substitutes the alias at *pt with the declared term (see termAliasSubst), the
+// numeral at *pt with the Church numeral, or the list at *pt with its encoding.
+// A numeral n above CHURCH_MAX is unfolded one step at a time, to
+// \f.\x.f ((n-1) f x), so that using a large number as a function does not
+// build it all at once, and so is a list (see termUnfoldList).
+
+#define CHURCH_MAX	99999
+
+static int termExpand(TERM **pt) {
+	TERM *t = termWritable(pt), *c, *n, *nf, *nfx;
+	char shared = t->shared;
+	unsigned short refs = t->refs;
 
-	newTerm = termNew();
-	newTerm->type = t->type;
-	newTerm->preced = t->preced;
-	newTerm->closed = t->closed;
-	//newTerm->assoc = t->assoc;			// assoc used only in parsing, no need to copy it
+	if(t->type == TM_LIST) {
+		termReplace(t, termUnfoldList(t->list));
+		return 0;
+	}
 
-	if(t->type == TM_VAR || t->type == TM_ALIAS)
-		newTerm->name = strdup(t->name);
-	else {														//TM_ABRST or TM_APPL
-		newTerm->name = NULL;
-		newTerm->lterm = termClone(t->lterm);
-		newTerm->rterm = termClone(t->rterm);
+	if(t->type == TM_NUM) {
+		if(t->big || t->num > CHURCH_MAX) {
+			n = termNew();
+			termSetNumeral(n, t->num - 1, t->big ? bigMonus(t->big, bigFromInt(1)) : NULL);
+
+			// \f.\x.f x becomes \f.\x.f ((n-1) f x)
+			c = termChurchNum(1);
+
+			nf = termNew();
+			nf->type = TM_APPL;
+			nf->name = NULL;
+			nf->lterm = n;
+			nf->rterm = termClone(c->rterm->rterm->lterm);
+
+			nfx = termNew();
+			nfx->type = TM_APPL;
+			nfx->name = NULL;
+			nfx->lterm = nf;
+			nfx->rterm = c->rterm->rterm->rterm;
+			c->rterm->rterm->rterm = nfx;
+		} else
+			c = termChurchNum(t->num);
+		termSetClosedFlag(c);
+		termReplace(t, c);
+		return 0;
 	}
 
-	return newTerm;
+	if(termAliasSubst(t, 1) != 0)
+		return 1;
+
+	t->shared = shared;
+	t->refs = refs;
+	return 0;
 }
 
 // termSubst
 //
-// Replaces variable x in term M with term N.
+// Replaces variable x in term *pM with term N.
 // Substitution is performed based on the definition at page 149 of the lecture notes
 // (update: 15 years later, the above comment sounds funny and useless :D)
 //
@@ -206,132 +580,791 @@ TERM *termClone(TERM *t) {
 // (constant time). It is not always possible to detect that a term became closed
 // without cost, so a term marked as non-closed could in fact be closed. But the
 // opposite should hold, terms marked as closed MUST be closed.
+//
+// *pM may be shared, in this case it is not modified but replaced by a private copy
+// (only if a substitution actually happens in it). The first occurrence of x is
+// replaced by N itself and the others by new references to it (N becomes shared),
+// so if 1 is returned N has become part of *pM.
+//
+// The terms whose children are being visited are kept in the stack, with their
+// stage and, if they are shared, the child itself. The child of a shared term is
+// visited through a reference of our own (held by the stack item), the term is
+// copied only if the child is replaced.
+
+int termSubst(TERM *x, TERM **pM, TERM *N, int mustClone) {
+	STACKITEM *base = stackPtr;
+	TERM *M, *y, *P, *z, *c, **slot;
+	char *name;
+	int found = 0, checked = 0;
+	STAGE stage;
+
+	for(;;) {
+		M = *pM;
+		stage = ST_NONE;
+
+		// nothing can be substituted in closed terms
+		if(!M->closed) switch(M->type) {
+		 case TM_VAR:
+		 	if(M->name == x->name) {
+				*pM = mustClone || found ? termShare(N) : N;
+				termFree(M);
 
-int termSubst(TERM *x, TERM *M, TERM *N, int mustClone) {
-	TERM z, *y, *P, *clone;
-	int found = 0;
-
-	// nothing can be substituted in closed terms
-	if(M->closed)
-		return 0;
-
-	switch(M->type) {
-	 case TM_VAR:
-	 	if(strcmp(M->name, x->name) == 0) {
-			free(M->name);
-			if(mustClone) {
-				clone = termClone(N);
-				*M = *clone;
-				free(clone);
-			} else
-				*M = *N;
-
-			found = 1;
-		}
-		break;
-
-	 case TM_APPL:
-		found = termSubst(x, M->lterm, N, mustClone);
-		found = termSubst(x, M->rterm, N, mustClone || found) || found;
+				found = 1;
+			}
+			break;
 
-		// if both branches become closed then M also becomes closed
-		M->closed = M->lterm->closed &&
-			 			M->rterm->closed;
-		break;
+		 case TM_APPL:
+			stage = ST_LEFT;
+			break;
 
-	 case TM_ABSTR:		
-		y = M->lterm;
-		P = M->rterm;
+		 case TM_ABSTR:
+			y = M->lterm;
+			P = M->rterm;
+
+			// case 1: x = y
+			if(y->name == x->name)
+				break;
+
+			// If y is free in N then we should alpha-convert it to a different name to avoid capture
+			// except if x is not free in P in which case no substitution will happen anyway
+			//
+			// NOTE
+			// termIsFreeVar is a very constly check to make, and it is performed billions of times.
+			// However, in 'practical' cases we never need to make such substitutions so these costly tests
+			// always fail (in Queens N example we never enter in the following if).
+			// Some profiling showed that 77% percent of the execution time was spent in termIsFree and
+			// putting the hole 'if' in comments leads to an incredible speed boost (Queens 5 solved in 2 seconds
+			// instead of 50) however it breaks the cases where substitution IS needed, for example where we
+			// have free variables:
+			//   (\x.\y.y x) y  ->  \a.a y  (bound y renamed to a)
+			//   but with the 'if' in comments we incorrectly get \y.y y
+			//
+			// Starting with version 0.5 a good optimization is made using the term's 'closed' flag. In practical
+			// cases we are using only closed terms. To exploit this fact each term has a closed flag which is calculated
+			// once in the beggining of the execution and is updated during the conversions whenever possible without
+			// computational overhead. A closed flag means that termSubst and termIsFreeVar can return immediately without
+			// inspecting the term. This gives almost the same performance boost as removing the 'if' (but without breaking
+			// cases with free variables), still some termIsFrees are called but very few.
+			// Note: termIsFreeVar checks the closed flag itself but in the following 'if' we first check N->closed and
+			//       P->closed to avoid extra function calls and avoid calling termIsFreeVar(N, y->name) if P->closed is set
+			//
+			// N's flag may be stale (N can be a partly reduced argument, see call-by-need) so it is
+			// recomputed once, before the first check, instead of searching N at every abstraction.
+			//
+			if(!N->closed && !P->closed && !checked) {
+				termClosedFlag(N, 1);
+				checked = 1;
+			}
+			if(!N->closed && !P->closed &&
+				termIsFreeVar(N, y->name) &&	termIsFreeVar(P, x->name)
+				) {
+				//printf("ISFREE\n");
+
+				// x in FV(P) kai y in FV(N)
+				// bound variable must be renamed before performing P[x:=N]
+				z = termNew();
+				z->type = TM_VAR;
+				z->name = name = getVariable(N, P);
+
+				M = termUnshare(pM);
+				y = termUnshare(&M->lterm);
+				if(!termSubst(y, &M->rterm, z, 0))
+					termFree(z);
+				y->name = name;
+			}
+			stage = ST_BODY;
+			break;
 
-		// case 1: x = y
-		if(strcmp(y->name, x->name) == 0)
+		 case TM_ALIAS:
+		 case TM_NUM:
+		 case TM_LIST:
+			// aliases are closed terms so no substitution is possible
+			// We should never reach here because of the closed flag
+			assert(0);
 			break;
+		}
 
-		// If y is free in N then we should alpha-convert it to a different name to avoid capture
-		// except if x is not free in P in which case no substitution will happen anyway
-		//
-		// NOTE
-		// termIsFreeVar is a very constly check to make, and it is performed billions of times.
-		// However, in 'practical' cases we never need to make such substitutions so these costly tests
-		// always fail (in Queens N example we never enter in the following if).
-		// Some profiling showed that 77% percent of the execution time was spent in termIsFree and
-		// putting the hole 'if' in comments leads to an incredible speed boost (Queens 5 solved in 2 seconds
-		// instead of 50) however it breaks the cases where substitution IS needed, for example where we
-		// have free variables:
-		//   (\x.\y.y x) y  ->  \a.a y  (bound y renamed to a)
-		//   but with the 'if' in comments we incorrectly get \y.y y
-		//
-		// Starting with version 0.5 a good optimization is made using the term's 'closed' flag. In practical
-		// cases we are using only closed terms. To exploit this fact each term has a closed flag which is calculated
-		// once in the beggining of the execution and is updated during the conversions whenever possible without
-		// computational overhead. A closed flag means that termSubst and termIsFreeVar can return immediately without
-		// inspecting the term. This gives almost the same performance boost as removing the 'if' (but without breaking
-		// cases with free variables), still some termIsFrees are called but very few.
-		// Note: termIsFreeVar checks the closed flag itself but in the following 'if' we first check N->closed and
-		//       P->closed to avoid extra function calls and avoid calling termIsFreeVar(N, y->name) if P->closed is set
-		// 
-		if(!N->closed && !P->closed &&
-			termIsFreeVar(N, y->name) &&	termIsFreeVar(P, x->name)
-			) {
-			//printf("ISFREE\n");
-
-			// x in FV(P) kai y in FV(N)
-			// bound variable must be renamed before performing P[x:=N]
-			z.type = TM_VAR;
-			z.name = getVariable(N, P);
-			z.closed = 0;
-
-			termSubst(y, P, &z, 1);
-			y->name = z.name;
-		}
-		found = termSubst(x, P, N, mustClone);
-
-		// if P becomes closed then M also becomes closed
-		M->closed = P->closed;
-		break;
+		// go up until a term with a child left to visit is found
+		while(stage == ST_NONE) {
+			if(stackPtr == base)
+				return found;
+
+			c = POP(t);
+			stage = POP(n);
+			pM = POP(pt);
+
+			// the child of a shared term replaces the old one only if it has changed
+			if(c) {
+				M = *pM;
+				slot = stage == ST_LEFT ? &M->lterm : &M->rterm;
+				if(c != *slot)
+					termSetChild(pM, stage != ST_LEFT, c);
+				else
+					termFree(c);
+			}
+
+			M = *pM;
+			switch(stage) {
+			 case ST_LEFT:
+				stage = ST_RIGHT;
+				break;
+
+			 case ST_RIGHT:
+				// if both branches become closed then M also becomes closed
+				if(M->lterm->closed && M->rterm->closed)
+					termUnshare(pM)->closed = 1;
+				stage = ST_NONE;
+				break;
+
+			 default:
+				// if P becomes closed then M also becomes closed
+				if(M->rterm->closed)
+					termUnshare(pM)->closed = 1;
+				stage = ST_NONE;
+			}
+		}
 
-	 case TM_ALIAS:
-		// aliases are closed terms so no substitution is possible
-		// We should never reach here because of the closed flag
-		assert(0);
-		break;
+		// continue with the child (the children of a private term are modified in place)
+		M = *pM;
+		slot = stage == ST_LEFT ? &M->lterm : &M->rterm;
+
+		PUSH(pt, pM);
+		PUSH(n, stage);
+		if(!M->shared) {
+			PUSH(t, NULL);
+			pM = slot;
+		} else {
+			termRef(*slot);
+			PUSH(t, *slot);
+			pM = &STACK_TOP->t;
+		}
 	}
-
-	return found;
 }
 
 // Returns 1 if variable 'name' belongs to the free variables of term t, otherwise 0.
+// name must be interned. Right children still to be checked are kept in the stack.
 
 #ifndef NDEBUG
 int freeNo;				// count the number of calls of termIsFree
 #endif
 int termIsFreeVar(TERM *t, char *name) {
-	// closed terms have no free variables
-	if(t->closed)
-		 return 0;
+	STACKITEM *base = stackPtr;
+
+	for(;;) {
+		// closed terms have no free variables
+		if(!t->closed) {
 #ifndef NDEBUG
-	freeNo++;
+			freeNo++;
 #endif
+			switch(t->type) {
+			 case TM_VAR:
+				if(t->name == name) {
+					while(stackPtr != base)
+						(void)POP(t);
+					return 1;
+				}
+				break;
+
+			 case TM_APPL:
+				PUSH(t, t->rterm);
+				t = t->lterm;
+				continue;
+
+			 case TM_ABSTR:
+				if(t->lterm->name != name) {
+					t = t->rterm;
+					continue;
+				}
+				break;
+
+			 case TM_ALIAS:
+			 case TM_NUM:
+			 case TM_LIST:
+				// aliases must be closed terms (no free variables)!
+				break;
+
+			 default:		// we never reach here!
+				assert(0);
+			}
+		}
+
+		if(stackPtr == base) return 0;
+		t = POP(t);
+	}
+}
+
+// termIsEta
+//
+// Returns 1 if t is an eta-redex \x.M x with x not free in M
+
+static int termIsEta(TERM *t) {
+	TERM *L = t->rterm;
+
+	return t->type == TM_ABSTR &&
+		L->type == TM_APPL &&
+		L->rterm->type == TM_VAR &&
+		L->rterm->name == t->lterm->name &&
+		!termIsFreeVar(L->lterm, t->lterm->name);
+}
+
+// termEta
+//
+// Performs the eta-reduction of the redex at *pt (see termBeta)
+
+static int termEta(TERM **pt) {
+	TERM *t = termWritable(pt), *L, *M, *N, *x;
+
+	L = t->rterm;			// M x
+	M = L->lterm;
+	N = L->rterm;
+	x = t->lterm;
+
+	// free memory (M is kept through a reference of its own if L is shared)
+	if(L->shared) {
+		termRef(M);
+		termFree(L);
+	} else {
+		termFreeNode(L);
+		termFree(N);
+	}
+	termFree(x);
+
+	termReplace(t, M);
+
+	return 1;
+}
+
+// termBeta
+//
+// Performs the beta-reduction of the redex at *pt. The subterms of the redex can
+// be shared, *pt is replaced if it was shared itself (unless it is a thunk).
+
+static int termBeta(TERM **pt) {
+	TERM *t = termWritable(pt), *L, *M, *N, *x;
+	int found;
+	char closed;
+
+	L = t->lterm;
+	x = L->lterm;
+	M = L->rterm;
+	N = t->rterm;
+
+	// beta-reduction (M is substituted through a reference of its own if L is shared)
+	if(L->shared)
+		termRef(M);
+	found = termSubst(x, &M, N, 0);
+
+	// if t was closed, it remains closed (bete-conversion does not introduce free variables)
+	// however the inverse can happen, a non-closed t can become closed if M becomes
+	// closed itself (for example if x does not appear in M then any possible free variables of N
+	// will disapear after the beta-conversion)
+	closed = M->closed || t->closed;
+
+	// free memory (if found, N has become part of M)
+	if(L->shared)
+		termFree(L);
+	else {
+		termFreeNode(L);
+		termFree(x);
+	}
+	if(!found)
+		termFree(N);
+
+	termReplace(t, M);
+	t->closed = closed;
+
+	return 1;
+}
+
+// Builtins
+//
+// Numerals are kept as TM_NUM terms, which stand for the Church numeral of their
+// value and are expanded to it only when they are applied (see termExpand). An
+// alias bound to a builtin (see Prim and prim.c) that is applied to as many
+// arguments as the builtin takes is computed by it, in a single reduction,
+// instead of being expanded. Its strict arguments must already be numerals,
+// lists etc. in normal form, or calls of builtins that can be computed; they
+// are not reduced, since the expanded alias might not need them (Times 0 M is
+// 0 even if M has no normal form). Only the arguments of strict applications
+// (see APPL_STRICT) are reduced first, as they would be anyway. If the builtin
+// cannot handle the arguments the alias is expanded as usual, the result is the
+// same.
+
+// termNumber
+//
+// Returns 1 if t is a numeral (or a Church numeral) and stores its value in *n,
+// or in *big if it does not fit in an int (*big is NULL otherwise)
+
+int termNumber(TERM *t, int *n, BIGNUM **big) {
+	if(t->type == TM_NUM && t->big) {
+		*big = t->big;
+		return 1;
+	}
+
+	*big = NULL;
+	*n = termIdentity(t) ? 1 : termNatural(t);
+	return *n >= 0;
+}
+
+// termPrimCall
+//
+// Returns the builtin of the alias at the head of t and stores its arguments in
+// args, if t is the call of an alias bound to a builtin, otherwise -1
+
+static int termPrimCall(TERM *t, TERM **args) {
+	TERM *l = t->lterm;
+	DECL *decl;
+	int n, p;
+
+	if(l->type == TM_ALIAS)
+		n = 1;
+	else if(l->type == TM_APPL && l->lterm->type == TM_ALIAS)
+		n = 2;
+	else
+		return -1;
+
+	if(!(decl = getDecl(n == 1 ? l->name : l->lterm->name)) ||
+		(p = declPrim(decl)) == -1 || primArity(p) != n)
+		return -1;
+
+	args[0] = n == 1 ? t->rterm : l->rterm;
+	args[1] = t->rterm;
+	return p;
+}
+
+// ARG_NORMAL
+//
+// The argument of a builtin is known to be in normal form
+
+#define ARG_NORMAL(t)	((t)->type == TM_NUM || (t)->shared == 2)
+
+static TERM *termPrimValue(TERM *t);
+static TERM *termNumeralValue(TERM *t, int value);
+
+// termPrimApply
+//
+// Returns the result of builtin p for args (NULL if it does not apply). An
+// argument that is itself a call of a builtin is passed as its result, if it
+// can be computed (see termPrimValue), so that a builtin can work on the
+// result of another, as in Length (1..n). Otherwise a strict argument that is
+// not in normal form makes the builtin not apply; a Church numeral is, even
+// when it is not marked so (it was substituted for a variable). Bit i of
+// normal is set if args[i] is known to be in normal form (it has just been
+// reduced).
+
+static TERM *termPrimApply(int p, TERM **args, int normal) {
+	TERM *vals[PRIM_MAXARGS], *res = NULL;
+	BIGNUM *big;
+	int i, k, n = primArity(p);
+
+	for(i = 0; i < n; i++) {
+		vals[i] = !(normal & 1 << i) && (prims[p].args[i] == 'l' || !ARG_NORMAL(args[i]))
+			? termPrimValue(args[i])
+			: NULL;
+		if(vals[i])
+			args[i] = vals[i];
+		else if(prims[p].args[i] == 's' && !(normal & 1 << i) && !ARG_NORMAL(args[i]) &&
+			!termNumber(args[i], &k, &big))
+			break;
+	}
+
+	if(i == n)
+		res = prims[p].fn(args);
+
+	while(--i >= 0)
+		if(vals[i])
+			termFree(vals[i]);
+	return res;
+}
+
+// termPrimValue
+//
+// Returns the result of t if it is a call of a builtin, or an application of a
+// numeral that termShortcut computes, that can be computed without reducing
+// its arguments, otherwise NULL. The result is a new term.
+
+static TERM *termPrimValue(TERM *t) {
+	TERM *args[PRIM_MAXARGS];
+	int p;
+
+	if(t->type != TM_APPL)
+		return NULL;
+	return (p = termPrimCall(t, args)) != -1
+		? termPrimApply(p, args, 0)
+		: termNumeralValue(t, 1);
+}
+
+// termPrimResult
+//
+// Replaces the application *pt with res, the result of a builtin
+
+static void termPrimResult(TERM **pt, TERM *res) {
+	TERM *t = termWritable(pt);
+
+	termSetClosedFlag(res);
+	termFree(t->lterm);
+	termFree(t->rterm);
+	termReplace(t, res);
+}
+
+// termPrim
+//
+// Calls the builtin of the alias at the head of *pt, if *pt is the call of an
+// alias bound to a builtin (see termReduce). Builtins take one or two
+// arguments, those of strict applications are searched first, the first of two
+// in stage ST_ARG1 and the last one in ST_ARG2. Stage is ST_NONE when *pt is
+// reached, otherwise the stage of the argument that has been searched and found
+// in normal form. It is changed to the argument to be searched next, or to
+// ST_AGAIN if the alias has been expanded (the builtin does not apply), then
+// *pt must be searched again. Returns 1 if the builtin was applied, -1 on
+// error, otherwise 0 (and ST_NONE if *pt is not such a call).
+
+static int termPrim(TERM **pt, STAGE *stage) {
+	TERM *t = *pt, *l = t->lterm, *args[PRIM_MAXARGS], *res, **head;
+	int i, n, p, normal;
+
+	if((p = termPrimCall(t, args)) == -1)
+		return 0;
+	n = primArity(p);
+
+	// the arguments of strict applications (see APPL_STRICT) after the one
+	// searched last, they are in normal form once searched
+	for(i = 0, normal = 0; i < n; i++)
+		if(APPL_STRICT(i == n - 1 ? t->preced : l->preced, valueMode))
+			normal |= 1 << i;
+	for(i = *stage == ST_NONE ? 0 : *stage == ST_ARG1 ? 1 : n; i < n; i++) {
+		if(!(normal & 1 << i) || ARG_NORMAL(args[i]))
+			continue;
+
+		if(i == n - 1)
+			*stage = ST_ARG2;
+		else {
+			// the argument is modified in place
+			t = termWritable(pt);
+			l = termWritable(&t->lterm);
+			if(t->shared && !l->shared)
+				termMarkShared(l);
+			*stage = ST_ARG1;
+		}
+		return 0;
+	}
+
+	if((res = termPrimApply(p, args, normal))) {
+		termPrimResult(pt, res);
+		*stage = ST_NONE;
+		return 1;
+	}
+
+	// the alias is expanded (through any synonyms)
+	t = termWritable(pt);
+	if(n == 1)
+		head = &t->lterm;
+	else {
+		l = termWritable(&t->lterm);
+		if(t->shared && !l->shared)
+			termMarkShared(l);
+		head = &l->lterm;
+	}
+	while((*head)->type == TM_ALIAS) {
+		if(termExpand(head) != 0) {
+			*stage = ST_NONE;
+			return -1;
+		}
+		if((n == 1 ? t : l)->shared && !(*head)->shared)
+			termMarkShared(*head);
+	}
+
+	*stage = ST_AGAIN;
+	return 0;
+}
+
+// termNumeralValue
+//
+// Returns the result of the application t of a numeral m (or a Church numeral)
+// to a numeral a, or to an alias bound to Increment or Decrement and a numeral
+// a (see primNumeral), or NULL if it is not such an application. So m 10 is
+// 10^m and b Decrement a, the body of Monus, is a-b. A lazy argument a that is
+// a call of a builtin is computed, as in termPrimApply. If value is set the
+// result is the argument of a builtin, then 0 a (which is I) is 1 and 1 a is a.
+// The result is a new term.
+
+static TERM *termNumeralValue(TERM *t, int value) {
+	TERM *m = t->lterm, *a = t->rterm, *val = NULL, *res;
+	DECL *decl;
+	BIGNUM *big;
+	int f = -1, n;
+
+	if(m->type == TM_APPL && m->rterm->type == TM_ALIAS) {
+		if(!(decl = getDecl(m->rterm->name)) || (f = declPrim(decl)) == -1 ||
+			primArity(f) != 1)
+			return NULL;
+		m = m->lterm;
+	}
+	if(m->type != TM_NUM && m->type != TM_ABSTR)
+		return NULL;
+
+	if(a->type == TM_APPL && (val = termPrimValue(a)))
+		a = val;
+
+	if(value && f == -1 && termNumber(m, &n, &big) && !big && n < 2) {
+		if(n == 0) {
+			res = termNew();
+			termSetNumeral(res, 1, NULL);
+		} else if(val)
+			return val;
+		else
+			res = ARG_NORMAL(a) ? termClone(a) : NULL;
+	} else
+		res = primNumeral(m, f, a);
+
+	if(val)
+		termFree(val);
+	return res;
+}
+
+// termShortcut
+//
+// Computes the application *pt of a numeral in a single reduction instead of
+// expanding it, if termNumeralValue can. The shortcut is not taken if *pt is
+// applied to some term (it is the left child of an application): the result
+// would be expanded at once, to a Church numeral as large as itself (or
+// unfolded one step at a time above CHURCH_MAX), while m applies a lazily,
+// which is much faster when the iterations are evaluated strictly (see
+// APPL_STRICT). Returns 1 if *pt was replaced by the result, otherwise 0.
+
+static int termShortcut(TERM **pt, int applied) {
+	TERM *res;
+
+	if(applied || !(res = termNumeralValue(*pt, 0)))
+		return 0;
+
+	termPrimResult(pt, res);
+	return 1;
+}
+
+// termChild
+//
+// Returns the slot of the child of t that is searched in stage. The arguments
+// of a builtin (see termPrim) are children too.
+
+static TERM **termChild(TERM *t, STAGE stage) {
+	return
+		stage == ST_LEFT ? &t->lterm :
+		stage == ST_ARG1 ? &t->lterm->rterm :
+		&t->rterm;
+}
+
+// termStep
+//
+// Checks whether the term at *pt is a redex, the part of the search for the
+// left-most reduction shared by termReduce and termConvNext. If it is, the
+// reduction is performed and 1 (or -1 on error) is returned. Otherwise returns 0
+// and stores in *stage the child of *pt to be searched next, ST_NONE if it has
+// none, or ST_AGAIN if *pt has been expanded and must be checked again. Applied
+// is set if *pt is the left child of an application (see termShortcut).
+
+static int termStep(TERM **pt, STAGE *stage, int applied) {
+	TERM *t = *pt;
+	int res = 0;
+
+	*stage = ST_NONE;
 
 	switch(t->type) {
 	 case TM_VAR:
-		return (strcmp(t->name, name) == 0);
+		break;
 
-	 case TM_APPL:
-		return termIsFreeVar(t->lterm, name) ||
-				 termIsFreeVar(t->rterm, name);
+	 case TM_NUM:
+		// 1 is \f.\x.f x, it contains an eta-redex
+		if(t->num == 1) {
+			termExpand(pt);
+			res = termEta(&(*pt)->rterm);
+		}
+		break;
+
+	 case TM_LIST:
+		// a list that is not in normal form is unfolded (see LIST_NORMAL)
+		if(LIST_NORMAL(t->list))
+			break;
+		termExpand(pt);
+		*stage = ST_AGAIN;
+		break;
 
 	 case TM_ABSTR:
-		return strcmp(t->lterm->name, name) != 0 &&
-				 termIsFreeVar(t->rterm, name);
-	
+		// Check for eta-conversion
+		// \x.M x -> M  if x not free in M
+		if(termIsEta(t))
+			res = termEta(pt);
+		else
+			*stage = ST_BODY;
+		break;
+
+	 case TM_APPL:
+		// The call of an alias bound to a builtin is computed instead, its
+		// arguments are searched first (see termPrim)
+		if((res = termPrim(pt, stage)) != 0 || *stage != ST_NONE)
+			break;
+
+		// A numeral applied to a numeral, or to Increment or Decrement and a
+		// numeral, is computed too
+		if((res = termShortcut(pt, applied)) != 0)
+			break;
+
+		// If the left-most term is an alias it needs to be substituted cause it might contain
+		// an abstraction. while is needed cause we might still have an alias afterwards.
+		// The same holds for numerals and lists.
+		while((t->lterm->type == TM_ALIAS || t->lterm->type == TM_NUM ||
+				 t->lterm->type == TM_LIST) && res == 0) {
+			t = termWritable(pt);
+			if(termExpand(&t->lterm) != 0)
+				res = -1;
+			else if(t->shared && !t->lterm->shared)
+				termMarkShared(t->lterm);
+		}
+		if(res != 0)
+			break;
+
+		// If no abstraction exist on the left-hand side then a beta-reduction is not possible,
+		// so we continue the search in the tree.
+		if(t->lterm->type != TM_ABSTR)
+			*stage = ST_LEFT;
+
+		// If the application has been defined with ~ (or is strict because of the
+		// strategy, see APPL_STRICT) we perform the reductions in the right subtree
+		// first (call-by-value)
+		else if(APPL_STRICT(t->preced, valueMode))
+			*stage = ST_VALUE;
+
+		else
+			res = termBeta(pt);
+		break;
+
 	 case TM_ALIAS:
-		// aliases must be closed terms (no free variables)!
-		return 0;
+		// to check for reductions we need to substitute the alias with the corresponding term
+		if(termExpand(pt) != 0) {
+			res = -1;
+			break;
+		}
+
+		// search for reductions in the new term
+		*stage = ST_AGAIN;
+		break;
 
-	 default:		// we never reach here!
+	 default:										// we never reach here!
 		assert(0);
-		return 0;
+		res = -1;
+	}
+
+	return res;
+}
+
+// termReduce
+//
+// Performs the left-most beta or eta reduction in term *pt (see termConv). The
+// subterms of a reduced term can be shared (parts of declarations), these are
+// never modified: termUnshare replaces them with private copies, so *pt itself
+// is replaced if it was shared and a reduction happened in it.
+//
+// The terms whose children are being searched are kept in the stack, as in
+// termSubst. The right child of an application or abstraction is searched
+// without a stack item when it is private, since there is nothing left to do
+// for its parent, so long right spines need no stack at all. A shared child
+// is replaced if a reduction happens in it, otherwise it is marked as being
+// in normal form so that it is never searched again (shared terms don't change).
+// Applied is set if *pt is the left child of an application (see termShortcut).
+
+static int termReduce(TERM **pt, int applied) {
+	STACKITEM *base = stackPtr;
+	TERM *t, *c, **slot;
+	int res, own;
+	STAGE stage;
+
+	for(;;) {
+		t = *pt;
+		res = 0;
+		stage = ST_NONE;
+
+		// verify that the closed bit has been set and is not garbage
+		assert(t->closed == 0 || t->closed == 1);
+
+		// shared term already found to be in normal form
+		if(t->shared != 2)
+			res = termStep(pt, &stage, applied);
+
+		// go up until a term with a child left to search is found
+		while(stage == ST_NONE) {
+			if(stackPtr == base)
+				return res;
+
+			c = POP(t);
+			stage = POP(n);
+			pt = POP(pt);
+			applied = 0;
+
+			// a shared child of a writable term is reduced in place, the child of a
+			// shared term through a reference of our own. A private copy of the
+			// child of a thunk becomes shared. (The first argument of a builtin is a
+			// child of a writable term, see termPrim.)
+			t = *pt;
+			own = stage & ST_OWNREF;
+			stage &= ~ST_OWNREF;
+			slot = termChild(t, stage);
+			if(c && !own) {
+				if(res == 0 && *slot == c)
+					c->shared = 2;
+				if((stage == ST_ARG1 ? t->lterm : t)->shared && !(*slot)->shared)
+					termMarkShared(*slot);
+			} else if(c) {
+				if(c != *slot)
+					termSetChild(pt, stage != ST_LEFT, c);
+				else {
+					if(res == 0)
+						c->shared = 2;
+					termFree(c);
+				}
+			}
+
+			if(res != 0)
+				stage = ST_NONE;
+			else if(stage == ST_LEFT)
+				stage = ST_RIGHT;
+			else if(stage == ST_VALUE) {
+				res = termBeta(pt);
+				stage = ST_NONE;
+			} else if(stage == ST_ARG1 || stage == ST_ARG2)
+				res = termPrim(pt, &stage);
+			else
+				stage = ST_NONE;
+		}
+
+		if(stage == ST_AGAIN)
+			continue;
+
+		// search the child
+		t = *pt;
+		slot = termChild(t, stage);
+		c = *slot;
+		applied = stage == ST_LEFT;
+
+		if(WRITABLE(c) && (stage == ST_RIGHT || stage == ST_BODY)) {
+			pt = slot;
+			continue;
+		}
+
+		PUSH(pt, pt);
+		if(WRITABLE(c)) {
+			PUSH(n, stage);
+			PUSH(t, NULL);
+			pt = slot;
+		} else if(WRITABLE(t)) {
+			PUSH(n, stage);
+			PUSH(t, c);
+			pt = slot;
+		} else {
+			termRef(c);
+			PUSH(n, stage | ST_OWNREF);
+			PUSH(t, c);
+			pt = &STACK_TOP->t;
+		}
 	}
 }
 
@@ -351,103 +1384,213 @@ int termIsFreeVar(TERM *t, char *name) {
 // opposite should hold, terms marked as closed MUST be closed.
 
 int termConv(TERM *t) {
-	TERM *L, *M, *N, *x;
-	int res, found;
-	char closed;
+	TERM *root = t;
+	int res;
 
-	// verify that the closed bit has been set and is not garbage
-	assert(t->closed == 0 || t->closed == 1);
+	needMode = getOption(OPT_STRATEGY) == STR_NEED;
+	valueMode = getOption(OPT_STRATEGY) == STR_VALUE;
+	res = termReduce(&root, 0);
 
-	switch(t->type) {
-	 case TM_VAR:
-		return 0;
+	// a query is never shared, so it is reduced in place
+	assert(root == t);
+	return res;
+}
 
-	 case TM_ABSTR:
-		// Check for eta-conversion
-		// \x.M x -> M  if x not free in M
-		L = t->rterm;			// M x
-		M = L->lterm;
-		N = L->rterm;
-		x = t->lterm;
+// termConvStart, termConvNext
+//
+// Perform the same sequence of reductions as repeated calls of termConv, but
+// each search for a redex continues next to the previous one instead of
+// starting again from the root of the term.
+//
+// The terms on the path from the root to the last contracted term are kept in
+// zipPath, all of them writable (a search entering a declaration is completed
+// by termReduce, see below). The terms before the contracted one in normal
+// order are left unchanged by the reduction, so apart from the contracted term
+// itself only the following can have become redexes:
+// 	- the parent, if the contracted term is its left child (beta) or its
+// 	  body (eta)
+// 	- the grandparent \x.M N, if N was the contracted term (N may now be x)
+// 	- abstractions \x.M x with the contracted term inside M (x may no longer
+// 	  be free in M), which are kept in zipCand when the search enters them
+// These are checked, outermost first, before the search continues. The calls
+// of builtins whose arguments are being searched (see termPrim) are checked
+// when the search goes up to them.
+
+typedef struct {
+	TERM **pt;						// slot of the term
+	STAGE stage;					// which child of the term is searched
+} ZIPFRAME;
+
+static TERM *zipRoot;
+static TERM **zipFocus;				// slot of the last contracted term, NULL before the first
+static ZIPFRAME *zipPath = NULL;
+static int zipPathNo, zipPathSize = 0;
+static int *zipCand = NULL;		// positions in zipPath of abstractions \x.M x
+static int zipCandNo, zipCandSize = 0;
+
+void termConvStart(TERM *t) {
+	needMode = getOption(OPT_STRATEGY) == STR_NEED;
+	valueMode = getOption(OPT_STRATEGY) == STR_VALUE;
+	zipRoot = t;
+	zipFocus = NULL;
+	zipPathNo = zipCandNo = 0;
+}
 
-		if(L->type == TM_APPL &&
-			N->type == TM_VAR &&
-			strcmp(N->name, x->name) == 0
-			&& !termIsFreeVar(M, x->name)) {
+// zipPush
+//
+// Appends the term at pt to the path, the search continues with its child
 
-			// eta-conversion
-			*t = *M;
+static void zipPush(TERM **pt, STAGE stage) {
+	TERM *t = *pt;
 
-			// free memory
-			free(M);
-			free(L);
-			termFree(N);
-			termFree(x);
+	if(zipPathNo == zipPathSize &&
+		!(zipPath = realloc(zipPath, (zipPathSize = zipPathSize ? 2 * zipPathSize : 1024) * sizeof(ZIPFRAME)))) {
+		fprintf(stderr, "Error: out of memory.\n");
+		exit(1);
+	}
+
+	// an abstraction \x.M x which is not an eta-redex (x is free in M)
+	if(stage == ST_BODY &&
+		t->rterm->type == TM_APPL &&
+		t->rterm->rterm->type == TM_VAR &&
+		t->rterm->rterm->name == t->lterm->name) {
 
-			return 1;
+		if(zipCandNo == zipCandSize &&
+			!(zipCand = realloc(zipCand, (zipCandSize = zipCandSize ? 2 * zipCandSize : 64) * sizeof(int)))) {
+			fprintf(stderr, "Error: out of memory.\n");
+			exit(1);
 		}
+		zipCand[zipCandNo++] = zipPathNo;
+	}
 
-		return termConv(t->rterm);
+	zipPath[zipPathNo].pt = pt;
+	zipPath[zipPathNo].stage = stage;
+	zipPathNo++;
+}
 
-	 case TM_APPL:
-		// If the left-most term is an alias it needs to be substituted cause it might contain
-		// an abstraction. while is needed cause we might still have an alias afterwards.
-		while(t->lterm->type == TM_ALIAS)
-			if(termAliasSubst(t->lterm) != 0)
-				return -1;
+// zipTruncate
+//
+// Removes the terms from position n on from the path
 
-		// If no abstraction exist on the left-hand side then a beta-reduction is not possible,
-		// so we continue the search in the tree.
-		if(t->lterm->type != TM_ABSTR) {
-			res = termConv(t->lterm);
-			return res != 0
-				? res
-				: termConv(t->rterm);
+static void zipTruncate(int n) {
+	zipPathNo = n;
+	while(zipCandNo > 0 && zipCand[zipCandNo-1] >= n)
+		zipCandNo--;
+}
+
+// zipResume
+//
+// Returns the slot of the term where the search continues after the previous
+// reduction (see termConvNext)
+
+static TERM **zipResume() {
+	int i, n = zipPathNo;
+
+	// abstractions \x.M x above the parent
+	for(i = 0; i < zipCandNo && zipCand[i] < n - 1; i++)
+		if(termIsEta(*zipPath[zipCand[i]].pt)) {
+			zipTruncate(zipCand[i]);
+			return zipPath[zipPathNo].pt;
 		}
 
-		// If preced == 255 then the application has beed defined with ~. In this case
-		// we perform the reductions in the right subtree first (call-by-value)
-		if(t->preced == 255 && (res = termConv(t->rterm)) != 0)
-			return res;
+	// grandparent \x.M N with N contracted
+	if(n >= 2 &&
+		(zipPath[n-1].stage == ST_RIGHT || zipPath[n-1].stage == ST_ARG2) &&
+		zipPath[n-2].stage == ST_BODY &&
+		termIsEta(*zipPath[n-2].pt)) {
+		zipTruncate(n - 2);
+		return zipPath[zipPathNo].pt;
+	}
 
-		L = t->lterm;
-		x = L->lterm;
-		M = L->rterm;
-		N = t->rterm;
-
-		// beta-reduction
-		closed = t->closed;
-		found = termSubst(x, M, N, 0);
-		*t = *M;
-
-		// if t was closed, it remains closed (bete-conversion does not introduce free variables)
-		// however the inverse can happen, a non-closed t can become closed if M becomes
-		// closed itself (for example if x does not appear in M then any possible free variables of N
-		// will disapear after the beta-conversion)
-		t->closed = M->closed || closed;
-
-		// free memory
-		free(L);
-		free(M);
-		termFree(x);
-		if(found)
-			free(N);
-		else
-			termFree(N);
+	// parent whose left child or body was contracted
+	if(n >= 1 &&
+		(zipPath[n-1].stage == ST_LEFT || zipPath[n-1].stage == ST_BODY)) {
+		zipTruncate(n - 1);
+		return zipPath[zipPathNo].pt;
+	}
 
-		return 1;
+	return zipFocus;
+}
 
-	 case TM_ALIAS:
-		// to check for reductions we need to substitute the alias with the corresponding term
-		if(termAliasSubst(t) != 0)
-			return -1;
+int termConvNext(TERM *t) {
+	TERM **pt, *c, **slot;
+	int res, done = 0;
+	STAGE stage;
+
+	assert(t == zipRoot);
+	pt = zipFocus ? zipResume() : &zipRoot;
+
+	for(;;) {
+		t = *pt;
+		res = 0;
+		stage = ST_NONE;
+
+		// verify that the closed bit has been set and is not garbage
+		assert(t->closed == 0 || t->closed == 1);
+
+		// the same checks as termReduce (the term is writable)
+		if(!done && t->shared != 2)
+			res = termStep(pt, &stage, zipPathNo > 0 && zipPath[zipPathNo-1].stage == ST_LEFT);
+		done = 0;
+
+		// go up until a term with a child left to search is found
+		while(res == 0 && stage == ST_NONE) {
+			// the term is in normal form, a thunk is never searched again
+			if((*pt)->shared == 1)
+				(*pt)->shared = 2;
+
+			if(zipPathNo == 0)
+				break;
+
+			zipTruncate(zipPathNo - 1);
+			pt = zipPath[zipPathNo].pt;
+			stage = zipPath[zipPathNo].stage;
+
+			if(stage == ST_LEFT)
+				stage = ST_RIGHT;
+			else if(stage == ST_VALUE) {
+				res = termBeta(pt);
+				stage = ST_NONE;
+			} else if(stage == ST_ARG1 || stage == ST_ARG2)
+				res = termPrim(pt, &stage);
+			else
+				stage = ST_NONE;
+		}
 
-		// search for reductions in the new term
-		return termConv(t);
+		if(res != 0 || stage == ST_NONE) {
+			zipFocus = pt;
+			if(res != 1)
+				termConvStart(zipRoot);
+			return res;
+		}
 
-	 default:										// we never reach here!
-		assert(0);
-		return -1;
+		if(stage == ST_AGAIN)
+			continue;
+
+		// search the child. A shared child is searched by termReduce, which
+		// replaces it by a private copy if it performs a reduction in it, the
+		// search continues from the copy next time.
+		zipPush(pt, stage);
+		t = *pt;
+		slot = termChild(t, stage);
+		c = *slot;
+
+		if(!WRITABLE(c)) {
+			res = termReduce(slot, stage == ST_LEFT);
+			if((stage == ST_ARG1 ? t->lterm : t)->shared && !(*slot)->shared)
+				termMarkShared(*slot);
+
+			if(res != 0) {
+				zipFocus = slot;
+				if(res != 1)
+					termConvStart(zipRoot);
+				return res;
+			}
+			if(*slot == c)
+				c->shared = 2;
+			done = 1;
+		}
+		pt = slot;
 	}
 }
 
@@ -456,7 +1599,7 @@ int termConv(TERM *t) {
 // Return true or false depending on if term t is the identity function
 
 int termIdentity(TERM *t) {
-    return (t->type == TM_ABSTR && t->rterm->type == TM_VAR && strcmp(t->lterm->name, t->rterm->name) == 0);
+    return (t->type == TM_ABSTR && t->rterm->type == TM_VAR && t->lterm->name == t->rterm->name);
 }
 
 // termBoolean
@@ -474,30 +1617,30 @@ int termBoolean(TERM *t) {
 	// second term must be \x. with x != f
 	if(t->rterm->type != TM_ABSTR) return -1;
 	x = (t->rterm->lterm);
-	if(strcmp(f->name, x->name) == 0) return -1;
+	if(f->name == x->name) return -1;
 
 	// third term must be either f or x
 	if (t->rterm->rterm->type != TM_VAR) return -1;
 	body = t->rterm->rterm;
 
-	return strcmp(body->name, f->name) == 0;
+	return body->name == f->name;
 }
 
 // termPower
 //
 // Returns term f^pow(a) = a if pow == 0, f( f^{pow-1}(a) ) otherwise
+// The term is built from the inside out.
 
 TERM *termPower(TERM *f, TERM *a, int pow) {
-	TERM *newTerm;
-
-	if(pow == 0)
-		newTerm = termClone(a);
-	else {
-		newTerm = termNew();
-		newTerm->type = TM_APPL;
-		newTerm->name = NULL;
-		newTerm->lterm = termClone(f);
-		newTerm->rterm = termPower(f, a, pow-1);
+	TERM *newTerm = termClone(a), *appl;
+
+	for(; pow > 0; pow--) {
+		appl = termNew();
+		appl->type = TM_APPL;
+		appl->name = NULL;
+		appl->lterm = termClone(f);
+		appl->rterm = newTerm;
+		newTerm = appl;
 	}
 
 	return newTerm;
@@ -514,10 +1657,10 @@ TERM *termChurchNum(int n) {
 		  *x  = termNew();
 
 	f->type = TM_VAR;
-	f->name = strdup("f");
+	f->name = intern("f");
 
 	x->type = TM_VAR;
-	x->name = strdup("x");
+	x->name = intern("x");
 
 	l1->type = TM_ABSTR;
 	l1->name = NULL;
@@ -532,14 +1675,32 @@ TERM *termChurchNum(int n) {
 	return l1;
 }
 
+// termSetNumeral
+//
+// Makes t the numeral big, or n if big is NULL. Numbers that fit in an int are
+// always kept in num.
+
+void termSetNumeral(TERM *t, int n, BIGNUM *big) {
+	t->type = TM_NUM;
+	t->name = NULL;
+	t->big = NULL;
+	t->num = n;
+
+	if(big && (t->num = bigToInt(big)) == -1)
+		t->big = big;
+}
+
 // termNatural
 //
-// If term t is a church numeral then return its corresponding number, otherwise -1
+// If term t is a church numeral then return its corresponding number, otherwise
+// -1 (also for numerals that do not fit in an int)
 
 int termNatural(TERM *t) {
 	TERM *f, *x, *cur;
 	int n = 0;
 
+	if(t->type == TM_NUM) return t->big ? -1 : t->num;
+
 	// first term must be \f.
 	if(t->type != TM_ABSTR) return -1;
 	f = t->lterm;
@@ -547,20 +1708,27 @@ int termNatural(TERM *t) {
 	// second term must be \x. with x != f
 	if(t->rterm->type != TM_ABSTR) return -1;
 	x = (t->rterm->lterm);
-	if(strcmp(f->name, x->name) == 0) return -1;
+	if(f->name == x->name) return -1;
 
 	// recognize term f^n(x), compute n
 	for(cur = t->rterm->rterm; ; cur = cur->rterm, n++) {
-		if(cur->type == TM_VAR && strcmp(cur->name, x->name) == 0)
+		if(cur->type == TM_VAR && cur->name == x->name)
 			return n;
 
 		if(cur->type != TM_APPL ||
 			cur->lterm->type != TM_VAR ||
-			strcmp(cur->lterm->name, f->name) != 0)
+			cur->lterm->name != f->name)
 			return -1;
 	}
 }	
 
+// IS_ABSTR
+//
+// The elements of lists and maybes are recognized as abstractions, numerals and
+// packed lists are abstractions too (their encodings)
+
+#define IS_ABSTR(t)	((t)->type == TM_ABSTR || (t)->type == TM_NUM || (t)->type == TM_LIST)
+
 // termIsPair
 //
 // Returns 1 if t is a Church pair that is of the form
@@ -574,7 +1742,7 @@ int termIsPair(TERM *t) {
 	r = t->rterm;
 	return (r->type == TM_APPL && r->lterm->type == TM_APPL &&
 		r->lterm->lterm->type == TM_VAR &&
-		strcmp(r->lterm->lterm->name, t->lterm->name) == 0);
+		r->lterm->lterm->name == t->lterm->name);
 }
 
 // termPrintPair
@@ -601,32 +1769,35 @@ void termPrintPair(TERM *t) {
 int termIsString(TERM *t) {
 	TERM *r;
 
-	if(t->type != TM_ABSTR) return 0;
+	// the Tail of each pair is checked in turn
+	for(;; t = r->rterm) {
+		if(t->type != TM_ABSTR) return 0;
 
-	r = t->rterm;
-	switch(r->type) {
-	 case TM_APPL:
-		// check for the form \s.s Head Tail
-		if(r->lterm->type == TM_APPL &&
-			r->lterm->lterm->type == TM_VAR &&
-			termNatural(r->lterm->rterm) >= 0 && termNatural(r->lterm->rterm) <= 255 &&
-			strcmp(r->lterm->lterm->name, t->lterm->name) == 0)
-			return termIsString(r->rterm);
-		break;
+		r = t->rterm;
+		switch(r->type) {
+		 case TM_APPL:
+			// check for the form \s.s Head Tail
+			if(r->lterm->type == TM_APPL &&
+				r->lterm->lterm->type == TM_VAR &&
+				termNatural(r->lterm->rterm) >= 0 && termNatural(r->lterm->rterm) <= 255 &&
+				r->lterm->lterm->name == t->lterm->name)
+				continue;
+			break;
 
-	 case TM_ABSTR:
-		// check for the form Nil: \x.\x.\y.x
-		if(r->rterm->type == TM_ABSTR &&
-			r->rterm->rterm->type == TM_VAR &&
-			strcmp(r->rterm->rterm->name, r->lterm->name) == 0)
-			return 1;
-		break;
+		 case TM_ABSTR:
+			// check for the form Nil: \x.\x.\y.x
+			if(r->rterm->type == TM_ABSTR &&
+				r->rterm->rterm->type == TM_VAR &&
+				r->rterm->rterm->name == r->lterm->name)
+				return 1;
+			break;
 
-	 default:
-		;
-	}
+		 default:
+			;
+		}
 
-	return 0;
+		return 0;
+	}
 }
 
 // termPrintString
@@ -663,8 +1834,8 @@ int termIsMaybe(TERM *t) {
        // match Just N
 	   (r->type == TM_APPL &&
 	   (t->lterm && t->lterm->name) && (r && r->lterm && r->lterm->name) &&
-	   strcmp(t->lterm->name, r->lterm->name) == 0 &&
-	   r->rterm->type == TM_ABSTR);
+	   t->lterm->name == r->lterm->name &&
+	   IS_ABSTR(r->rterm));
 }
 
 // termPrintMaybe
@@ -697,17 +1868,17 @@ int termIsList(TERM *t) {
 	r = t->rterm;
 	if(r->type == TM_APPL &&
 	   (t->lterm && t->lterm->name) && (r && r->lterm && r->lterm->name) &&
-	   strcmp(t->lterm->name, r->lterm->name) == 0 &&
-	   r->rterm->type == TM_ABSTR) return 1;
+	   t->lterm->name == r->lterm->name &&
+	   IS_ABSTR(r->rterm)) return 1;
 
 	char * c_name = t->lterm->name;
-	if(!c_name || !(r->lterm) || !(r->lterm->name)) return 0;
+	if(!c_name || r->type != TM_ABSTR || !(r->lterm->name)) return 0;
 	char * n_name = r->lterm->name;
 
     r = r->rterm;
     while(r && r->type == TM_APPL) {
-        if((r && r->lterm && r->lterm->lterm && r->lterm->lterm->name && r->lterm->rterm) &&
-           strcmp(r->lterm->lterm->name, c_name) == 0 && r->lterm->type == TM_APPL && r->lterm->rterm->type == TM_ABSTR) {
+        if(r->lterm->type == TM_APPL && r->lterm->lterm->name &&
+           r->lterm->lterm->name == c_name && IS_ABSTR(r->lterm->rterm)) {
             r = r->rterm;
             continue;
         }
@@ -717,7 +1888,7 @@ int termIsList(TERM *t) {
 
     if(!r || !(r->name)) return 0;
 
-    return strcmp(r->name, n_name) == 0;
+    return r->name == n_name;
 }
 
 // termPrintList
@@ -731,7 +1902,7 @@ void termPrintList(TERM *t) {
 
 	putchar('[');
 
-	if(r->type == TM_APPL && strcmp(t->lterm->name, r->lterm->name) == 0 && r->rterm->type == TM_ABSTR) {
+	if(r->type == TM_APPL && t->lterm->name == r->lterm->name && IS_ABSTR(r->rterm)) {
         termPrint(r->rterm, 1);
 	} else {
         r = r->rterm;
@@ -750,21 +1921,31 @@ void termPrintList(TERM *t) {
 //
 // Substitutes aliast t with its corresponding term. Returns 0 if the term was found
 // or 1 if the alias is undefined.
+//
+// Only the root node of the declared term is copied, its subterms are shared
+// with the declaration (if share is 0 a full clone is made instead).
 
-int termAliasSubst(TERM *t) {
+int termAliasSubst(TERM *t, int share) {
+	DECL *decl;
 	TERM *newTerm;
 
-	if(!(newTerm = termFromDecl(t->name))) {
+	if(!(decl = getDecl(t->name))) {
 		printf("Error: Alias %s is not declared.\n", t->name);
 		return 1;
 	}
 
-	assert(newTerm->closed == 1);
+	assert(decl->term->closed == 1);
 
 	// substitute term
-	free(t->name);
-	*t = *newTerm;
-	free(newTerm);
+	if(share) {
+		*t = *decl->term;
+		t->shared = 0;
+		t->refs = 0;
+	} else {
+		newTerm = termClone(decl->term);
+		*t = *newTerm;
+		termFreeNode(newTerm);
+	}
 
 	return 0;
 }
@@ -773,89 +1954,135 @@ int termAliasSubst(TERM *t) {
 //
 // Substitutes all aliases in term t with the corresponding terms. Returns 0 if
 // all substitutions were successful, or 1 if some alias was undefined.
-// If id != NULL the only this specific alias is substituted.
+// If id != NULL the only this specific alias is substituted (id must be interned).
 
 int termRemoveAliases(TERM *t, char *id) {
+	STACKITEM *base = stackPtr;
 
-	switch(t->type) {
-	 case(TM_VAR):
-		 return 0;
-
-	 case(TM_ABSTR):
-		 return termRemoveAliases(t->rterm, id);
+	for(;;) {
+		switch(t->type) {
+		 case(TM_VAR):
+		 case(TM_NUM):
+		 case(TM_LIST):
+			break;
 
-	 case(TM_APPL):
-		 return termRemoveAliases(t->lterm, id) ||
-				  termRemoveAliases(t->rterm, id);
+		 case(TM_ABSTR):
+			t = t->rterm;
+			continue;
+
+		 case(TM_APPL):
+			PUSH(t, t->rterm);
+			t = t->lterm;
+			continue;
+
+		 case(TM_ALIAS):
+			if((!id || id == t->name) && termAliasSubst(t, 0)) {
+				while(stackPtr != base)
+					(void)POP(t);
+				return 1;
+			}
+			break;
 
-	 case(TM_ALIAS):
-		return !id || strcmp(id, t->name) == 0
-			? termAliasSubst(t)
-			: 0;
+			//Antikatastash mono enos epipedoy
+			//return termRemoveAliases(t);
 
-		//Antikatastash mono enos epipedoy
-		//return termRemoveAliases(t);
+		 default:				//we never reach here
+			break;
+		}
 
-	 default:				//we never reach here
-		return 0;
+		if(stackPtr == base) return 0;
+		t = POP(t);
 	}
 }
 
 // termAlias2Var
 //
 // Replaces all occurrences of an aliast with a variable. Used when removing recursion
-// via a fixed point combinator.
+// via a fixed point combinator. alias and var must be interned.
 
 void termAlias2Var(TERM *t, char *alias, char *var) {
+	STACKITEM *base = stackPtr;
 
-	switch(t->type) {
-	 case(TM_VAR):
-		return;
+	for(;;) {
+		switch(t->type) {
+		 case(TM_VAR):
+		 case(TM_NUM):
+		 case(TM_LIST):
+			break;
 
-	 case(TM_ABSTR):
-		termAlias2Var(t->rterm, alias, var);
-		return;
+		 case(TM_ABSTR):
+			t = t->rterm;
+			continue;
 
-	 case(TM_APPL):
-		termAlias2Var(t->lterm, alias, var);
-		termAlias2Var(t->rterm, alias, var);
-		return;
+		 case(TM_APPL):
+			PUSH(t, t->rterm);
+			t = t->lterm;
+			continue;
 
-	 case(TM_ALIAS):
-		if(strcmp(alias, t->name) == 0) {
-			t->type = TM_VAR;
-			free(t->name);
-			t->name = strdup(var);
+		 case(TM_ALIAS):
+			if(alias == t->name) {
+				t->type = TM_VAR;
+				t->name = var;
+			}
+			break;
 		}
-		return;
+
+		if(stackPtr == base) return;
+		t = POP(t);
 	}
 }
 
+// termRemoveOper
+//
+// Converts the applications of operators to applications of the corresponding
+// aliases. The children of an application are converted before the application
+// itself, the applications waiting for their children are kept in the stack
+// (with n = 1, their children with n = 0).
+
 void termRemoveOper(TERM *t) {
+	STACKITEM *base = stackPtr;
 	TERM *alias, *appl;
-	
-	switch(t->type) {
-	 case(TM_VAR):
-	 case(TM_ALIAS):
-		break;
 
-	 case(TM_ABSTR):
-		termRemoveOper(t->rterm);
-		break;
+	PUSH(t, t);
+	PUSH(n, 0);
+
+	while(stackPtr != base) {
+		if(POP(n) == 0) {
+			t = POP(t);
+			switch(t->type) {
+			 case(TM_VAR):
+			 case(TM_ALIAS):
+			 case(TM_NUM):
+			 case(TM_LIST):
+				break;
+
+			 case(TM_ABSTR):
+				PUSH(t, t->rterm);
+				PUSH(n, 0);
+				break;
+
+			 case(TM_APPL):
+				PUSH(t, t);
+				PUSH(n, 1);
+				PUSH(t, t->rterm);
+				PUSH(n, 0);
+				PUSH(t, t->lterm);
+				PUSH(n, 0);
+				break;
+			}
+			continue;
+		}
 
-	 case(TM_APPL):
-		termRemoveOper(t->lterm);
-		termRemoveOper(t->rterm);
+		t = POP(t);
 
 		//	If t has a name the it's an operator. In this case we perform the conversion:
 		//		a op b -> 'op' a b
 		//
 		//	Operator '~' has a special meaning, used during execution to decide the evaluation
-		//	order. Setting preced = 255 we just "mark" the term.
+		//	order. Setting preced = PRECED_VALUE we just "mark" the term.
 
-		if(t->name && strcmp(t->name, "~") == 0) {
-			t->preced = 255;
-			free(t->name);
+		if(t->name && t->name == intern("~")) {
+			t->preced = PRECED_VALUE;
 			t->name = NULL;
 
 		} else if(t->name) {
@@ -878,47 +2105,178 @@ void termRemoveOper(TERM *t) {
 			// t = (op a) b
 			t->lterm = appl;
 		}
+	}
+}
 
-		break;
+// termMarkStrategy
+//
+// Marks the applications of t according to the strategies declared for aliases
+// (see DefStrategy). The applications of a spine whose head is an alias with a
+// declared strategy are its calls, they are marked strict or lazy, the others
+// get the strategy of owner (the declaration t belongs to, NULL for a query).
+// So a lazy alias is also evaluated lazily inside, whatever the strategy (this
+// makes Y usable with the value strategy). Applications defined with ~ keep their
+// mark. Returns the number of applications whose mark changed.
+
+static int strategyMark(DECL *d) {
+	return !d ? 0 :
+		d->strategy == DS_STRICT ? PRECED_STRICT :
+		d->strategy == DS_LAZY ? PRECED_LAZY : 0;
+}
+
+int termMarkStrategy(TERM *t, DECL *owner) {
+	STACKITEM *base = stackPtr;
+	TERM *h, *a;
+	int mark, changed = 0;
+
+	for(;;) {
+		switch(t->type) {
+		 case(TM_ABSTR):
+			t = t->rterm;
+			continue;
+
+		 case(TM_APPL):
+			// the head of the spine decides, the arguments are visited later
+			for(h = t; h->type == TM_APPL; h = h->lterm)
+				;
+			mark = h->type == TM_ALIAS ? strategyMark(getDecl(h->name)) : 0;
+			if(!mark)
+				mark = strategyMark(owner);
+
+			for(a = t; a != h; a = a->lterm) {
+				if(a->preced != PRECED_VALUE && a->preced != mark &&
+					(mark || a->preced == PRECED_STRICT || a->preced == PRECED_LAZY)) {
+					a->preced = mark;
+					changed++;
+				}
+				PUSH(t, a->rterm);
+			}
+			t = h;
+			continue;
+
+		 default:
+			break;
+		}
+
+		if(stackPtr == base) return changed;
+		t = POP(t);
+	}
+}
+
+// termSetClosedFlag
+//
+// Sets the closed flag of t and all its subterms. A term is closed if every
+// variable in it is bound by an abstraction inside the term. The abstractions
+// above the current term are kept in env (the innermost last), so the binder of
+// a variable is found at some position of env. For each term we compute the
+// outermost such position over its variables (-1 if some variable is free), the
+// term is closed iff that position is not above the term itself.
+//
+// The terms whose children are being visited are kept in the stack, with their
+// stage and the position computed for their left child. If keep is set, terms
+// already marked as closed are not visited (see termSubst).
+
+static TERM **env = NULL;
+static int envSize = 0;
+
+static void termClosedFlag(TERM *t, int keep) {
+	STACKITEM *base = stackPtr;
+	int depth = 0, pos, i;
+	STAGE stage;
+
+	for(;;) {
+		stage = ST_NONE;
+		pos = INT_MAX;
+
+		if(!keep || !t->closed) switch(t->type) {
+		 case TM_VAR:
+			for(pos = depth - 1; pos >= 0 && env[pos]->lterm->name != t->name; pos--)
+				;
+			t->closed = 0;
+			break;
+
+		 case TM_ALIAS:
+		 case TM_NUM:
+		 case TM_LIST:
+			t->closed = 1;
+			break;
+
+		 case TM_ABSTR:
+			if(depth == envSize &&
+				!(env = realloc(env, (envSize = envSize ? 2 * envSize : 64) * sizeof(TERM*)))) {
+				fprintf(stderr, "Error: out of memory.\n");
+				exit(1);
+			}
+			env[depth++] = t;
+			stage = ST_BODY;
+			break;
+
+		 case TM_APPL:
+			stage = ST_LEFT;
+			break;
+		}
+
+		// go up until a term with a child left to visit is found
+		while(stage == ST_NONE) {
+			if(stackPtr == base)
+				return;
+
+			i = POP(n);
+			stage = POP(n);
+			t = POP(t);
+
+			switch(stage) {
+			 case ST_LEFT:
+				stage = ST_RIGHT;
+				break;
+
+			 case ST_RIGHT:
+				if(i < pos) pos = i;
+				t->closed = pos >= depth;
+				stage = ST_NONE;
+				break;
+
+			 default:
+				t->closed = pos >= --depth;
+				stage = ST_NONE;
+			}
+		}
+
+		// continue with the child (the item of the right child of an application
+		// keeps the position computed for the left one)
+		PUSH(t, t);
+		PUSH(n, stage);
+		PUSH(n, pos);
+		t = stage == ST_LEFT ? t->lterm : t->rterm;
 	}
 }
 
 void termSetClosedFlag(TERM *t) {
-	list_t *fvars = termFreeVars(t);
-	list_destroy_nodes(fvars);
-	list_destroy(fvars);
+	termClosedFlag(t, 0);
 }
 
-list_t* termFreeVars(TERM *t) {
-	list_t *vars, *rvars;
-	lnode_t *node;
+// termSetShared
+//
+// Sets the shared flag of t and all its subterms. Declared terms are shared, the
+// reduction uses them without copying and never modifies or frees them (their
+// references are not counted).
 
-	switch(t->type) {
-	 case(TM_VAR):
-		vars = list_create(LISTCOUNT_T_MAX);
-		list_append(vars, lnode_create(t->name));
-		break;
+void termSetShared(TERM *t, char shared) {
+	STACKITEM *base = stackPtr;
 
-	 case(TM_ALIAS):
-		vars = list_create(LISTCOUNT_T_MAX);
-		break;
+	for(;;) {
+		t->shared = shared;
+		t->refs = REFS_PERM;
 
-	 case(TM_ABSTR):
-		vars = termFreeVars(t->rterm);
-		while(node = list_find(vars, t->lterm->name, (int(*)(const void*, const void*))strcmp))
-			lnode_destroy(list_delete(vars, node));
-		break;
+		if(t->type == TM_APPL || t->type == TM_ABSTR) {
+			PUSH(t, t->rterm);
+			t = t->lterm;
+			continue;
+		}
 
-	 case(TM_APPL):
-		vars = termFreeVars(t->lterm);
-		rvars = termFreeVars(t->rterm);
-		list_transfer(vars, rvars, list_first(rvars));
-		list_destroy(rvars);
-		break;
+		if(stackPtr == base) return;
+		t = POP(t);
 	}
-
-	t->closed = list_isempty(vars);
-	return vars;
 }
 
 // Finds a variable not contained in lists l1 and l2, by trying all strings in
@@ -927,26 +2285,34 @@ list_t* termFreeVars(TERM *t) {
 
 char *getVariable(TERM *t1, TERM *t2) {
 	char s[10] = {'a', '\0'};
-	int curLen = 1, i;
 
 	// build strings until we find one not contained in one of the lists
-	while(termIsFreeVar(t1, s) || termIsFreeVar(t2, s)) {
-		// increment the last character. When it becomes 'z' we change it to 'a'
-		// and continue incrementing the previous character, etc (after "az" we
-		// have "ba").
-		for(i = curLen-1; i >= 0 && ++s[i] == 'z'; i--)
-			s[i] = 'a';
+	while(termIsFreeVar(t1, intern(s)) || termIsFreeVar(t2, intern(s)))
+		nextVariable(s);
 
-		// if all characters became 'z' we need to increase the size of the string,
-		// and start from 'aa...'
-		if(i < 0) {
-			s[curLen] = 'a';
-			s[++curLen] = '\0';
-		}
-	}
+	// string found, return its symbol
+	return intern(s);
+}
 
-	// string found, return a copy
-	return strdup(s);
+// nextVariable
+//
+// Changes s to the string following it in the order used by getVariable
+
+void nextVariable(char *s) {
+	int curLen = strlen(s), i;
+
+	// increment the last character. When it becomes 'z' we change it to 'a'
+	// and continue incrementing the previous character, etc (after "az" we
+	// have "ba").
+	for(i = curLen-1; i >= 0 && ++s[i] == 'z'; i--)
+		s[i] = 'a';
+
+	// if all characters became 'z' we need to increase the size of the string,
+	// and start from 'aa...'
+	if(i < 0) {
+		s[curLen] = 'a';
+		s[++curLen] = '\0';
+	}
 }
 
 
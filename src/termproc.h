@@ -20,25 +20,44 @@
 #include <config.h>
 #endif
 
-#include "kazlib/list.h"
 #include "grammar.h"
+#include "termalloc.h"
+#include "decllist.h"
+#include "number.h"
+#include "packed.h"
+
+
+// Marks kept in the preced of applications after termRemoveOper. A strict
+// application (defined with ~ or a call of a strict alias) has its argument
+// reduced before the beta-reduction. With the value strategy (value is set) so
+// does every application that is not a call of a lazy alias.
+#define PRECED_VALUE		255				// defined with ~
+#define PRECED_STRICT	254				// call of a strict alias (see termMarkStrategy)
+#define PRECED_LAZY		253				// call of a lazy alias
+
+#define APPL_STRICT(preced, value)	\
+	((preced) == PRECED_VALUE || (preced) == PRECED_STRICT || \
+	 ((value) && (preced) != PRECED_LAZY))
 
 
 void termPrint(TERM *t, int isMostRight);
-TERM *termNew();
-void termFree(TERM *t);
-void termGC();
 TERM *termClone(TERM *t);
 
-int termSubst(TERM *x, TERM *M, TERM *N, int mustClone);
+int termSubst(TERM *x, TERM **pM, TERM *N, int mustClone);
 int termIsFreeVar(TERM *t, char *name);
 int termConv(TERM *t);
+void termConvStart(TERM *t);
+int termConvNext(TERM *t);
 
 TERM *termPower(TERM *f, TERM *a, int pow);
 TERM *termChurchNum(int n);
+void termSetNumeral(TERM *t, int n, BIGNUM *big);
+void termSetList(TERM *t, LIST *l);
+TERM *termFromList(LIST *l);
 int termIdentity(TERM *t);
 int termBoolean(TERM *t);
 int termNatural(TERM *t);
+int termNumber(TERM *t, int *n, BIGNUM **big);
 int termIsString(TERM *t);
 void termPrintString(TERM *t);
 int termIsPair(TERM *t);
@@ -48,15 +67,17 @@ void termPrintMaybe(TERM *t);
 int termIsList(TERM *t);
 void termPrintList(TERM *t);
 
-int termAliasSubst(TERM *t);
+int termAliasSubst(TERM *t, int share);
 int termRemoveAliases(TERM *t, char *id);
 void termAlias2Var(TERM *t, char *alias, char *var);
 
 void termRemoveOper(TERM *t);
+int termMarkStrategy(TERM *t, DECL *owner);
 void termSetClosedFlag(TERM *t);
-list_t* termFreeVars(TERM *t);
+void termSetShared(TERM *t, char shared);
 
 char *getVariable(TERM *t1, TERM *t2);
+void nextVariable(char *s);
 
 
 #endif